@@ -0,0 +1,153 @@
+// Microbenchmark for the per-packet identity and dispatch path of the w1 server.
+// Compares the old string-keyed path (inet_ntop + ostringstream + std::set/std::map)
+// with the packed-key ClientTable and string_view parsing used by server.cpp now.
+//
+// Build: g++ -std=c++20 -O2 bench_dispatch.cpp -o bench_dispatch
+// Usage: bench_dispatch [num_clients] [num_packets]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "client_table.h"
+
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+  ++allocations;
+  if (void *ptr = malloc(size))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+struct Packet
+{
+  sockaddr_in addr;
+  const char *payload;
+};
+
+static const char *payloads[] = { "HELLO", "/c hello everyone", "/ans 42", "just chatting" };
+
+// Printed at the end so the optimizer cannot drop the dispatch work
+static size_t sink = 0;
+
+static void dispatch_legacy(const Packet &pkt, std::set<std::string> &known, std::map<std::string, sockaddr_in> &clients)
+{
+  char ip_str[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &(pkt.addr.sin_addr), ip_str, INET_ADDRSTRLEN);
+  int port = ntohs(pkt.addr.sin_port);
+
+  std::ostringstream oss;
+  oss << ip_str << ":" << port;
+  std::string client_id = oss.str();
+  std::string msg(pkt.payload);
+
+  clients[client_id] = pkt.addr;
+
+  if (msg.compare(0, 5, "HELLO") == 0)
+    sink += known.insert(client_id).second;
+  else if (msg.rfind("/c ", 0) == 0)
+    sink += clients.size();
+  else if (msg.rfind("/ans ", 0) == 0)
+    sink += std::stoi(msg.substr(5));
+  else
+    sink += msg.size();
+}
+
+struct BenchClient
+{
+  sockaddr_in addr;
+  bool known = false;
+};
+
+static void dispatch_flat(const Packet &pkt, ClientTable<BenchClient> &clients)
+{
+  const uint64_t key = client_key(pkt.addr);
+  std::string_view msg(pkt.payload);
+
+  bool inserted = false;
+  BenchClient &client = clients.insert(key, inserted);
+  if (inserted)
+    client.addr = pkt.addr;
+
+  if (msg.starts_with("HELLO"))
+  {
+    sink += !client.known;
+    client.known = true;
+  }
+  else if (msg.starts_with("/c "))
+    sink += clients.size();
+  else if (msg.starts_with("/ans "))
+  {
+    int ans = 0;
+    std::from_chars(msg.data() + 5, msg.data() + msg.size(), ans);
+    sink += ans;
+  }
+  else
+    sink += msg.size();
+}
+
+template<typename F>
+static void run(const char *name, const std::vector<Packet> &warmup, const std::vector<Packet> &packets, F &&dispatch)
+{
+  for (const Packet &pkt : warmup)
+    dispatch(pkt);
+
+  allocations = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const Packet &pkt : packets)
+    dispatch(pkt);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  printf("%-8s %12.0f packets/s  %6.2f allocations/packet\n", name,
+         packets.size() / elapsed.count(), double(allocations) / packets.size());
+}
+
+int main(int argc, const char **argv)
+{
+  const size_t numClients = argc > 1 ? atoi(argv[1]) : 1000;
+  const size_t numPackets = argc > 2 ? atoi(argv[2]) : 2000000;
+
+  std::vector<sockaddr_in> addrs(numClients);
+  for (size_t i = 0; i < numClients; ++i)
+  {
+    memset(&addrs[i], 0, sizeof(sockaddr_in));
+    addrs[i].sin_family = AF_INET;
+    addrs[i].sin_addr.s_addr = htonl(0x7f000001 + uint32_t(i / 50000));
+    addrs[i].sin_port = htons(10000 + i % 50000);
+  }
+
+  // Warm-up registers every client so the measured run is the steady state
+  std::vector<Packet> warmup, packets;
+  for (size_t i = 0; i < numClients; ++i)
+    warmup.push_back(Packet{ addrs[i], payloads[0] });
+  srand(1);
+  for (size_t i = 0; i < numPackets; ++i)
+    packets.push_back(Packet{ addrs[rand() % numClients], payloads[rand() % 4] });
+
+  printf("%zu clients, %zu packets\n", numClients, numPackets);
+
+  std::set<std::string> known;
+  std::map<std::string, sockaddr_in> legacyClients;
+  run("before", warmup, packets, [&](const Packet &pkt) { dispatch_legacy(pkt, known, legacyClients); });
+
+  ClientTable<BenchClient> clients;
+  run("after", warmup, packets, [&](const Packet &pkt) { dispatch_flat(pkt, clients); });
+
+  printf("checksum %zu\n", sink);
+
+  return 0;
+}
@@ -5,9 +5,15 @@
 #include <cstring>
 #include <cstdio>
 #include <iostream>
+#include <string>
+#include <chrono>
 #include <unistd.h>
 #include "socket_tools.h"
 
+// The server forgets clients silent for a minute; a client that only reads pings well before that
+constexpr auto keepalive_interval = std::chrono::seconds(20);
+
+// Usage: client [--uring]
 int main(int argc, const char **argv)
 {
   const char *port = "2025";
@@ -21,31 +27,51 @@ int main(int argc, const char **argv)
     return 1;
   }
 
+  const bool useUring = argc > 1 && strcmp(argv[1], "--uring") == 0;
+  std::unique_ptr<DgramReceiver> receiver = create_dgram_receiver(sfd, useUring ? DgramBackend::IoUring : DgramBackend::Recvmmsg);
+  const int recvfd = receiver->event_fd();
+
   std::string hello = "HELLO";
   sendto(sfd, hello.c_str(), hello.size(), 0, resAddrInfo.ai_addr, resAddrInfo.ai_addrlen);
+  auto lastSent = std::chrono::steady_clock::now();
 
   while (true)
   {
     fd_set readSet;
     FD_ZERO(&readSet);
-    FD_SET(sfd, &readSet);
+    FD_SET(recvfd, &readSet);
     FD_SET(STDIN_FILENO, &readSet);
 
-    int maxfd = std::max(sfd, STDIN_FILENO);
-    select(maxfd + 1, &readSet, nullptr, nullptr, nullptr);
+    auto untilKeepalive = lastSent + keepalive_interval - std::chrono::steady_clock::now();
+    auto waitUs = std::max<long long>(0, std::chrono::duration_cast<std::chrono::microseconds>(untilKeepalive).count());
+    timeval timeout = { time_t(waitUs / 1000000), suseconds_t(waitUs % 1000000) };
+
+    int maxfd = std::max(recvfd, STDIN_FILENO);
+    if (select(maxfd + 1, &readSet, nullptr, nullptr, &timeout) == 0)
+    {
+      std::string ping = "/ping";
+      sendto(sfd, ping.c_str(), ping.size(), 0, resAddrInfo.ai_addr, resAddrInfo.ai_addrlen);
+      lastSent = std::chrono::steady_clock::now();
+      continue;
+    }
 
-    if (FD_ISSET(sfd, &readSet))
+    if (FD_ISSET(recvfd, &readSet))
     {
-      char buf[1024];
-      sockaddr_in from;
-      socklen_t fromlen = sizeof(from);
-      ssize_t len = recvfrom(sfd, buf, sizeof(buf) - 1, 0, (sockaddr*)&from, &fromlen);
-      if (len > 0)
+      // Drain fully: with io_uring, completions left behind would not signal the eventfd again
+      constexpr int batchSize = 16;
+      Datagram msgs[batchSize];
+      int numMsgs = batchSize;
+      while (numMsgs == batchSize && (numMsgs = receiver->receive(msgs, batchSize)) > 0)
       {
-        buf[len] = '\0';
-        std::cout << "\n[Server]: " << buf << "\n>";
-        std::cout.flush();
+        for (int i = 0; i < numMsgs; ++i)
+        {
+          std::cout << "\n[Server]: ";
+          std::cout.write(msgs[i].data, msgs[i].size);
+          std::cout << "\n>";
+        }
+        receiver->release();
       }
+      std::cout.flush();
     }
 
     if (FD_ISSET(STDIN_FILENO, &readSet))
@@ -53,6 +79,7 @@ int main(int argc, const char **argv)
       std::string input;
       std::getline(std::cin, input);
       sendto(sfd, input.c_str(), input.size(), 0, resAddrInfo.ai_addr, resAddrInfo.ai_addrlen);
+      lastSent = std::chrono::steady_clock::now();
     }
   }
 
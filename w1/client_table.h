@@ -0,0 +1,139 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Client identity packed into 48 bits: IPv4 address in the upper 32 bits, port in the lower 16.
+inline uint64_t client_key(const sockaddr_in &addr)
+{
+  return (uint64_t(ntohl(addr.sin_addr.s_addr)) << 16) | ntohs(addr.sin_port);
+}
+
+// Flat open-addressing hash table keyed by client_key, with linear probing.
+// Key 0 (0.0.0.0:0) never comes from a real sender and marks an empty slot.
+// Values move when the table grows or an erase shifts them, so never keep pointers to them
+// across an insert or erase.
+template<typename T>
+class ClientTable
+{
+public:
+  explicit ClientTable(size_t capacity = 64)
+  {
+    size_t cap = 8;
+    while (cap < capacity)
+      cap *= 2;
+    reset(cap);
+  }
+
+  T *find(uint64_t key)
+  {
+    for (size_t i = home(key);; i = (i + 1) & mask)
+    {
+      if (slots[i].key == key)
+        return &slots[i].value;
+      if (slots[i].key == 0)
+        return nullptr;
+    }
+  }
+
+  // Returns the value stored for key, default-constructing it first if the key is new.
+  T &insert(uint64_t key, bool &inserted)
+  {
+    if ((count + 1) * 4 > slots.size() * 3)
+      grow();
+
+    for (size_t i = home(key);; i = (i + 1) & mask)
+    {
+      if (slots[i].key == key)
+      {
+        inserted = false;
+        return slots[i].value;
+      }
+      if (slots[i].key == 0)
+      {
+        slots[i].key = key;
+        ++count;
+        inserted = true;
+        return slots[i].value;
+      }
+    }
+  }
+
+  // Backward-shift deletion: later entries of the probe run move into the hole, so lookups
+  // never need tombstones.
+  bool erase(uint64_t key)
+  {
+    size_t hole = home(key);
+    while (slots[hole].key != key)
+    {
+      if (slots[hole].key == 0)
+        return false;
+      hole = (hole + 1) & mask;
+    }
+
+    for (size_t i = (hole + 1) & mask; slots[i].key != 0; i = (i + 1) & mask)
+    {
+      // An entry may fill the hole only if its home is not between the hole and its slot
+      if (((i - home(slots[i].key)) & mask) >= ((i - hole) & mask))
+      {
+        slots[hole] = std::move(slots[i]);
+        hole = i;
+      }
+    }
+    slots[hole] = Slot();
+    --count;
+    return true;
+  }
+
+  template<typename F>
+  void for_each(F &&fn)
+  {
+    for (Slot &slot : slots)
+      if (slot.key != 0)
+        fn(slot.key, slot.value);
+  }
+
+  size_t size() const { return count; }
+
+private:
+  struct Slot
+  {
+    uint64_t key = 0;
+    T value;
+  };
+
+  // Fibonacci hashing spreads the sequential ports of one host over the whole table
+  size_t home(uint64_t key) const { return (key * 0x9E3779B97F4A7C15ull) >> shift; }
+
+  void reset(size_t capacity)
+  {
+    slots.clear();
+    slots.resize(capacity);
+    mask = capacity - 1;
+    shift = 64;
+    for (size_t c = capacity; c > 1; c >>= 1)
+      --shift;
+    count = 0;
+  }
+
+  void grow()
+  {
+    std::vector<Slot> old;
+    old.swap(slots);
+    reset(old.size() * 2);
+    for (Slot &slot : old)
+    {
+      if (slot.key == 0)
+        continue;
+      bool inserted = false;
+      insert(slot.key, inserted) = std::move(slot.value);
+    }
+  }
+
+  std::vector<Slot> slots;
+  size_t mask = 0;
+  unsigned shift = 64;
+  size_t count = 0;
+};
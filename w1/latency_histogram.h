@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+// Latency histogram with power-of-two nanosecond buckets, so recording a sample is a
+// count-leading-zeros and an increment. Bucket b holds samples in [2^(b-1), 2^b) ns.
+class LatencyHistogram
+{
+public:
+  static constexpr int num_buckets = 40; // the last bucket starts at ~9 minutes
+
+  void record(uint64_t ns)
+  {
+    int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    if (bucket >= num_buckets)
+      bucket = num_buckets - 1;
+    ++buckets[bucket];
+    ++count;
+    sum += ns;
+    if (ns > max)
+      max = ns;
+  }
+
+  // Upper bound of the bucket that holds the given fraction of samples, in ns.
+  uint64_t percentile(double fraction) const
+  {
+    const uint64_t rank = uint64_t(fraction * count);
+    uint64_t seen = 0;
+    for (int b = 0; b < num_buckets; ++b)
+    {
+      seen += buckets[b];
+      if (seen > rank)
+      {
+        const uint64_t bound = b ? (uint64_t(1) << b) : 0;
+        return bound < max ? bound : max;
+      }
+    }
+    return max;
+  }
+
+  uint64_t size() const { return count; }
+
+  // Folds in samples recorded elsewhere, e.g. by another thread.
+  void merge(const LatencyHistogram &other)
+  {
+    for (int b = 0; b < num_buckets; ++b)
+      buckets[b] += other.buckets[b];
+    count += other.count;
+    sum += other.sum;
+    if (other.max > max)
+      max = other.max;
+  }
+
+  void dump(const char *name) const
+  {
+    if (count == 0)
+      return;
+    printf("%s: n=%llu avg=%.1fus p50<=%.1fus p99<=%.1fus p999<=%.1fus max=%.1fus\n", name,
+           (unsigned long long)count, sum / 1e3 / count,
+           percentile(0.5) / 1e3, percentile(0.99) / 1e3, percentile(0.999) / 1e3, max / 1e3);
+    for (int b = 0; b < num_buckets; ++b)
+      if (buckets[b])
+        printf("  <%10.1fus %llu\n", (uint64_t(1) << b) / 1e3, (unsigned long long)buckets[b]);
+  }
+
+  void reset() { *this = LatencyHistogram(); }
+
+private:
+  uint64_t buckets[num_buckets] = {};
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t max = 0;
+};
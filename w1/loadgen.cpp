@@ -0,0 +1,295 @@
+// Load generator for the w1 chat relay: thousands of simulated clients driven by a few threads,
+// each client with its own UDP socket on localhost, speaking the HELLO, /c, /mathduel and /ans
+// protocol of server.cpp. Chat lines carry their send time, so every copy the relay fans out
+// gives one fan-out latency sample, taken from the kernel arrival timestamp at the receiver.
+//
+// Usage: w1_loadgen [clients[,clients...]] [threads] [seconds] [chats_per_second]
+// A comma-separated client list runs one phase per count, e.g. 100,1000,4000. Phases run in
+// ascending order and reuse the sockets of earlier phases, so the server never keeps clients
+// that are not part of the phase being measured.
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "socket_tools.h"
+#include "latency_histogram.h"
+
+constexpr std::string_view chat_tag = "/c lg ";
+constexpr double duels_per_second = 10.0;
+constexpr auto settle_time = std::chrono::seconds(1);
+constexpr auto drain_time = std::chrono::milliseconds(500);
+
+struct alignas(64) WorkerStats
+{
+  std::atomic<uint64_t> received{0}; // read by the main thread for the per-second report
+  uint64_t chatsSent = 0;
+  uint64_t chatsDelivered = 0;
+  uint64_t duelRequests = 0;
+  uint64_t duelTasks = 0;
+  uint64_t duelWins = 0;
+  LatencyHistogram fanout;
+};
+
+struct Phase
+{
+  const std::vector<int> *sockets = nullptr;
+  size_t numClients = 0;
+  size_t numThreads = 0;
+  double chatRate = 0;
+  sockaddr_in server;
+  std::atomic<bool> sending{true};
+  std::atomic<bool> running{true};
+};
+
+static uint64_t to_ns(const timespec &ts)
+{
+  return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t realtime_ns()
+{
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return to_ns(now);
+}
+
+static void send_text(int sfd, const sockaddr_in &server, std::string_view text)
+{
+  sendto(sfd, text.data(), text.size(), 0, (const sockaddr*)&server, sizeof(server));
+}
+
+static void send_chat(int sfd, const sockaddr_in &server)
+{
+  char buf[64];
+  memcpy(buf, chat_tag.data(), chat_tag.size());
+  char *end = std::to_chars(buf + chat_tag.size(), buf + sizeof(buf), realtime_ns()).ptr;
+  send_text(sfd, server, std::string_view(buf, end - buf));
+}
+
+static void handle_reply(int sfd, const Phase &phase, WorkerStats &stats, std::string_view msg, const timespec &arrival)
+{
+  stats.received.fetch_add(1, std::memory_order_relaxed);
+
+  if (msg.starts_with(chat_tag))
+  {
+    uint64_t sentNs = 0;
+    std::string_view stamp = msg.substr(chat_tag.size());
+    if (std::from_chars(stamp.data(), stamp.data() + stamp.size(), sentNs).ec != std::errc())
+      return;
+    const uint64_t arrivalNs = arrival.tv_sec ? to_ns(arrival) : realtime_ns();
+    stats.fanout.record(arrivalNs > sentNs ? arrivalNs - sentNs : 0);
+    ++stats.chatsDelivered;
+    return;
+  }
+
+  // Slots are null-terminated by recv_batch, so sscanf can read the task in place
+  int a = 0, b = 0, c = 0;
+  if (sscanf(msg.data(), "Math Duel Started! Solve: %d * %d - %d", &a, &b, &c) == 3)
+  {
+    ++stats.duelTasks;
+    char answer[32];
+    int len = snprintf(answer, sizeof(answer), "/ans %d", a * b - c);
+    send_text(sfd, phase.server, std::string_view(answer, len));
+  }
+  else if (msg.starts_with("Победитель дуэли"))
+  {
+    ++stats.duelWins;
+  }
+}
+
+static void run_worker(Phase &phase, size_t index, WorkerStats &stats)
+{
+  const std::vector<int> &sockets = *phase.sockets;
+  int epfd = epoll_create1(0);
+  std::vector<int> own;
+  for (size_t i = index; i < phase.numClients; i += phase.numThreads)
+  {
+    own.push_back(sockets[i]);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = sockets[i];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sockets[i], &ev);
+  }
+  if (own.empty())
+  {
+    close(epfd);
+    return;
+  }
+
+  std::unique_ptr<RecvBatch> batch = std::make_unique<RecvBatch>();
+  init_recv_batch(*batch);
+
+  std::mt19937 rng(uint32_t(index) + 1);
+  const double chatRate = phase.chatRate / phase.numThreads;
+  const double duelRate = duels_per_second / phase.numThreads;
+  const auto start = std::chrono::steady_clock::now();
+
+  constexpr int max_events = 64;
+  epoll_event events[max_events];
+
+  while (phase.running.load(std::memory_order_relaxed))
+  {
+    if (phase.sending.load(std::memory_order_relaxed))
+    {
+      // Paced by elapsed time rather than by sleeping, so slow iterations catch up
+      const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      while (stats.chatsSent < uint64_t(elapsed * chatRate))
+      {
+        send_chat(own[rng() % own.size()], phase.server);
+        ++stats.chatsSent;
+      }
+      while (stats.duelRequests < uint64_t(elapsed * duelRate))
+      {
+        send_text(own[rng() % own.size()], phase.server, "/mathduel");
+        ++stats.duelRequests;
+      }
+    }
+
+    int numEvents = epoll_wait(epfd, events, max_events, 1);
+    for (int e = 0; e < numEvents; ++e)
+    {
+      const int sfd = events[e].data.fd;
+      int numMsgs = 0;
+      while ((numMsgs = recv_batch(sfd, *batch)) > 0)
+        for (int i = 0; i < numMsgs; ++i)
+          handle_reply(sfd, phase, stats, std::string_view(batch->slots[i], batch->msgs[i].msg_len), batch->arrivals[i]);
+    }
+  }
+  close(epfd);
+}
+
+static uint64_t total_received(const std::vector<std::unique_ptr<WorkerStats>> &stats)
+{
+  uint64_t total = 0;
+  for (const auto &s : stats)
+    total += s->received.load(std::memory_order_relaxed);
+  return total;
+}
+
+static void run_phase(const std::vector<int> &sockets, size_t numClients, size_t numThreads, int seconds,
+                      double chatRate, const sockaddr_in &server)
+{
+  Phase phase;
+  phase.sockets = &sockets;
+  phase.numClients = numClients;
+  phase.numThreads = numThreads;
+  phase.chatRate = chatRate;
+  phase.server = server;
+
+  std::vector<std::unique_ptr<WorkerStats>> stats;
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < numThreads; ++t)
+  {
+    stats.push_back(std::make_unique<WorkerStats>());
+    workers.emplace_back(run_worker, std::ref(phase), t, std::ref(*stats.back()));
+  }
+
+  uint64_t lastReceived = 0;
+  for (int s = 0; s < seconds; ++s)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    const uint64_t received = total_received(stats);
+    printf("  %zu clients: %llu msgs/s\n", numClients, (unsigned long long)(received - lastReceived));
+    lastReceived = received;
+  }
+  const uint64_t receivedInWindow = lastReceived;
+
+  // Let the relay flush what it still has queued before counting losses
+  phase.sending = false;
+  std::this_thread::sleep_for(drain_time);
+  phase.running = false;
+  for (std::thread &worker : workers)
+    worker.join();
+
+  WorkerStats sum;
+  for (const auto &s : stats)
+  {
+    sum.chatsSent += s->chatsSent;
+    sum.chatsDelivered += s->chatsDelivered;
+    sum.duelRequests += s->duelRequests;
+    sum.duelTasks += s->duelTasks;
+    sum.duelWins += s->duelWins;
+    sum.fanout.merge(s->fanout);
+  }
+
+  // Every chat line is broadcast to every client of the phase, the sender included
+  const uint64_t expected = sum.chatsSent * numClients;
+  printf("clients=%zu threads=%zu: %.0f msgs/s delivered, chats %llu, copies %llu/%llu (%.2f%%), "
+         "duels %llu/%llu, fan-out p50<=%.1fus p99<=%.1fus p999<=%.1fus\n",
+         numClients, numThreads, double(receivedInWindow) / seconds,
+         (unsigned long long)sum.chatsSent, (unsigned long long)sum.chatsDelivered, (unsigned long long)expected,
+         expected ? 100.0 * sum.chatsDelivered / expected : 0.0,
+         (unsigned long long)sum.duelTasks / 2, (unsigned long long)sum.duelRequests,
+         sum.fanout.percentile(0.5) / 1e3, sum.fanout.percentile(0.99) / 1e3, sum.fanout.percentile(0.999) / 1e3);
+}
+
+int main(int argc, const char **argv)
+{
+  const char *port = "2025";
+
+  std::vector<size_t> clientCounts;
+  for (const char *list = argc > 1 ? argv[1] : "1000"; *list;)
+  {
+    char *end = nullptr;
+    clientCounts.push_back(std::max(1l, strtol(list, &end, 10)));
+    list = *end == ',' ? end + 1 : end;
+  }
+  std::sort(clientCounts.begin(), clientCounts.end());
+  const size_t numThreads = argc > 2 ? std::max(1, atoi(argv[2])) : 4;
+  const int seconds = argc > 3 ? std::max(1, atoi(argv[3])) : 5;
+  const double chatRate = argc > 4 ? atof(argv[4]) : 200.0;
+
+  // One descriptor per simulated client
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  sockaddr_in server;
+  memset(&server, 0, sizeof(server));
+  std::vector<int> sockets;
+  for (size_t numClients : clientCounts)
+  {
+    const size_t firstNew = sockets.size();
+    while (sockets.size() < numClients)
+    {
+      addrinfo resAddrInfo;
+      int sfd = create_dgram_socket("localhost", port, &resAddrInfo);
+      if (sfd == -1)
+      {
+        printf("cannot create socket %zu\n", sockets.size());
+        return 1;
+      }
+      memcpy(&server, resAddrInfo.ai_addr, sizeof(server));
+      sockets.push_back(sfd);
+    }
+
+    // Register the new clients and give the server time to log them before measuring
+    for (size_t i = firstNew; i < numClients; ++i)
+      send_text(sockets[i], server, "HELLO");
+    std::this_thread::sleep_for(settle_time);
+
+    run_phase(sockets, numClients, numThreads, seconds, chatRate, server);
+  }
+
+  for (int sfd : sockets)
+    close(sfd);
+  return 0;
+}
@@ -1,148 +1,649 @@
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <unistd.h>
 #include <cstring>
 #include <cstdio>
 #include <iostream>
-#include <set>
-#include <map>
+#include <vector>
 #include <string>
-#include <sstream>
+#include <string_view>
+#include <charconv>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <cstdlib>
 #include <ctime>
+#include <chrono>
+#include <algorithm>
+#include <random>
 #include "socket_tools.h"
+#include "client_table.h"
+#include "latency_histogram.h"
+#include "timer_wheel.h"
+#include "session.h"
 
-int main(int argc, const char **argv)
+struct ClientInfo
 {
-  const char *port = "2025";
+  uint64_t key = 0;
+  sockaddr_in addr;
+  bool known = false;
+  TimerWheel::Clock::time_point lastSeen;
+  // Messages the kernel refused with EAGAIN, flushed in order once the socket is writable
+  std::vector<std::string> pending;
+};
+
+constexpr size_t max_pending_per_client = 64;
+
+constexpr auto client_idle_timeout = std::chrono::seconds(60);
+constexpr auto duel_timeout = std::chrono::seconds(30);
+
+// Message handed from one shard to another. Target key 0 means every client of the shard.
+// A non-zero duel makes it an answer from client target to a duel session of the receiving shard.
+struct ShardMessage
+{
+  std::shared_ptr<const std::string> text;
+  uint64_t target = 0;
+  uint64_t duel = 0;
+  int answer = 0;
+};
+
+// One worker thread with its own SO_REUSEPORT socket. The kernel keeps a client on the same
+// shard, so client state is shard-local; the inbox is the only part other shards touch.
+struct Shard
+{
+  int index = 0;
+  int sfd = -1;
+  int epfd = -1;
+  int wakefd = -1;
+
+  // recvfd is the socket itself for recvmmsg, the completion eventfd for io_uring
+  std::unique_ptr<DgramReceiver> receiver;
+  int recvfd = -1;
+
+  std::mutex inboxMutex;
+  std::vector<ShardMessage> inbox;
+};
+
+static std::vector<std::unique_ptr<Shard>> shards;
+static thread_local Shard *self = nullptr;
+
+static thread_local ClientTable<ClientInfo> clients;
+
+// Duel deadlines, idle eviction and stats dumps; the wheel's timerfd sits in the shard's epoll set
+static thread_local TimerWheel timers;
+// Read once per received batch, so marking a client as seen costs no clock call per packet
+static thread_local TimerWheel::Clock::time_point loop_now;
+
+// Time datagrams spent queued in the kernel before the loop got to them
+static thread_local LatencyHistogram queue_latency;
+constexpr auto stats_interval = std::chrono::seconds(5);
+
+struct DuelSlot
+{
+  uint64_t key;
+  Shard *shard;
+};
+
+// Where a client's duel runs: the shard whose thread owns the session, and its id there
+struct DuelSeat
+{
+  Shard *shard = nullptr;
+  uint64_t duel = 0;
+};
+
+struct DuelAnswer
+{
+  uint64_t key;
+  int value;
+};
+
+// Each duel is a Session on the shard that paired it. Pairing may match clients of different
+// shards, so the waiting client and the seats are shared under a lock; the sessions are not.
+static std::mutex duel_mutex;
+static DuelSlot duel_waiting = { 0, nullptr };
+static ClientTable<DuelSeat> duel_seats;
+static uint64_t next_duel_id = 1;
+
+// Answer mailboxes of the duel sessions running on this shard, by duel id
+static thread_local ClientTable<Mailbox<DuelAnswer>*> duels;
+// Duel tasks; per shard, since rand() is not thread safe. Seeded in run_shard.
+static thread_local std::minstd_rand duel_rng;
+
+static thread_local bool wants_writable = false;
+static thread_local std::vector<uint64_t> backlogged;
+
+static thread_local std::vector<ClientInfo*> out_clients;
+static thread_local std::vector<mmsghdr> out_msgs;
+static thread_local std::vector<iovec> out_iovs;
+
+struct ClientIdStr
+{
+  char str[32];
+};
 
-  int sfd = create_dgram_socket(nullptr, port, nullptr);
-  if (sfd == -1)
+// Only used for logging and announcements, never on the per-packet path
+static ClientIdStr format_client_id(uint64_t key)
+{
+  ClientIdStr id;
+  snprintf(id.str, sizeof(id.str), "%u.%u.%u.%u:%u",
+           unsigned(key >> 40) & 0xff, unsigned(key >> 32) & 0xff,
+           unsigned(key >> 24) & 0xff, unsigned(key >> 16) & 0xff, unsigned(key & 0xffff));
+  return id;
+}
+
+static void set_writable_interest(int sfd, bool enable)
+{
+  if (wants_writable == enable)
+    return;
+  wants_writable = enable;
+
+  epoll_event ev;
+  ev.events = (sfd == self->recvfd ? uint32_t(EPOLLIN) : 0u) | (enable ? uint32_t(EPOLLOUT) : 0u);
+  ev.data.fd = sfd;
+  epoll_ctl(self->epfd, EPOLL_CTL_MOD, sfd, &ev);
+}
+
+static void enqueue_pending(ClientInfo &client, const char *data, size_t size)
+{
+  if (client.pending.empty())
+    backlogged.push_back(client.key);
+  else if (client.pending.size() >= max_pending_per_client)
+    client.pending.erase(client.pending.begin()); // bounded: the oldest message is the least useful one
+  client.pending.emplace_back(data, size);
+}
+
+static void add_out_msg(ClientInfo &client, const char *data, size_t size)
+{
+  out_clients.push_back(&client);
+
+  iovec iov;
+  iov.iov_base = (void*)data;
+  iov.iov_len = size;
+  out_iovs.push_back(iov);
+
+  mmsghdr m;
+  memset(&m, 0, sizeof(m));
+  m.msg_hdr.msg_name = &client.addr;
+  m.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+  out_msgs.push_back(m);
+}
+
+// Sends everything collected by add_out_msg with one sendmmsg vector and returns
+// the number of messages the kernel accepted.
+static size_t flush_out_msgs(int sfd)
+{
+  // iovec storage may have moved while the vectors grew, so headers are linked only now
+  for (size_t i = 0; i < out_msgs.size(); ++i)
   {
-    printf("cannot create socket\n");
-    return 1;
+    out_msgs[i].msg_hdr.msg_iov = &out_iovs[i];
+    out_msgs[i].msg_hdr.msg_iovlen = 1;
   }
-  printf("listening!\n");
+  return send_batch(sfd, out_msgs.data(), out_msgs.size());
+}
 
-  std::set<std::string> known_clients;
-  std::map<std::string, sockaddr_in> clients;
+static void clear_out_msgs()
+{
+  out_clients.clear();
+  out_msgs.clear();
+  out_iovs.clear();
+}
 
-  std::set<std::string> duel_queue;
-  std::string duel_client1, duel_client2;
-  int correct_answer = 0;
-  bool duel_active = false;
+// Fans one message out to several clients at once. Clients that already have a backlog
+// get the message queued behind it, so per-client ordering is kept.
+template<typename Range>
+static void send_to_clients(int sfd, const Range &targets, std::string_view msg)
+{
+  clear_out_msgs();
+  for (ClientInfo *client : targets)
+  {
+    if (client->pending.empty())
+      add_out_msg(*client, msg.data(), msg.size());
+    else
+      enqueue_pending(*client, msg.data(), msg.size());
+  }
 
-  srand(time(NULL));
+  size_t sent = flush_out_msgs(sfd);
+  for (size_t i = sent; i < out_clients.size(); ++i)
+    enqueue_pending(*out_clients[i], msg.data(), msg.size());
+  clear_out_msgs();
 
-  while (true)
+  if (!backlogged.empty())
+    set_writable_interest(sfd, true);
+}
+
+static void send_to_client(int sfd, ClientInfo &client, std::string_view msg)
+{
+  ClientInfo *target[] = { &client };
+  send_to_clients(sfd, target, msg);
+}
+
+static void broadcast_local(int sfd, std::string_view msg)
+{
+  static thread_local std::vector<ClientInfo*> targets;
+  targets.clear();
+  clients.for_each([](uint64_t, ClientInfo &client) { targets.push_back(&client); });
+  send_to_clients(sfd, targets, msg);
+}
+
+static void deliver(int sfd, std::string_view msg, uint64_t target)
+{
+  if (target == 0)
+  {
+    broadcast_local(sfd, msg);
+    return;
+  }
+  if (ClientInfo *client = clients.find(target))
+    send_to_client(sfd, *client, msg);
+}
+
+static void post_to_shard(Shard &shard, ShardMessage msg)
+{
+  {
+    std::lock_guard<std::mutex> lock(shard.inboxMutex);
+    shard.inbox.push_back(std::move(msg));
+  }
+  uint64_t one = 1;
+  write(shard.wakefd, &one, sizeof(one));
+}
+
+static void answer_duel(uint64_t duel, const DuelAnswer &answer)
+{
+  if (Mailbox<DuelAnswer> **mailbox = duels.find(duel))
+    (*mailbox)->push(answer);
+}
+
+static void drain_inbox(int sfd)
+{
+  uint64_t counter = 0;
+  read(self->wakefd, &counter, sizeof(counter));
+
+  static thread_local std::vector<ShardMessage> received;
+  {
+    std::lock_guard<std::mutex> lock(self->inboxMutex);
+    received.swap(self->inbox);
+  }
+  for (const ShardMessage &msg : received)
+  {
+    if (msg.duel != 0)
+      answer_duel(msg.duel, DuelAnswer{ msg.target, msg.answer });
+    else
+      deliver(sfd, *msg.text, msg.target);
+  }
+  received.clear();
+}
+
+static void send_to_id(int sfd, const DuelSlot &to, std::string_view msg)
+{
+  if (to.shard == self)
+    deliver(sfd, msg, to.key);
+  else
+    post_to_shard(*to.shard, ShardMessage{ std::make_shared<const std::string>(msg), to.key });
+}
+
+// Sends to this shard's clients directly and hands one shared copy of the text to every other shard.
+static void broadcast(int sfd, std::string_view msg)
+{
+  if (shards.size() > 1)
+  {
+    auto text = std::make_shared<const std::string>(msg);
+    for (auto &shard : shards)
+      if (shard.get() != self)
+        post_to_shard(*shard, ShardMessage{ text, 0 });
+  }
+  broadcast_local(sfd, msg);
+}
+
+// Called on EPOLLOUT: sends the head of every backlogged queue with one sendmmsg per round
+// until all queues are empty or the kernel pushes back again.
+static void flush_backlog(int sfd)
+{
+  while (!backlogged.empty())
+  {
+    clear_out_msgs();
+    size_t kept = 0;
+    for (uint64_t key : backlogged)
+    {
+      ClientInfo *client = clients.find(key);
+      if (!client || client->pending.empty())
+        continue;
+      backlogged[kept++] = key;
+      const std::string &head = client->pending.front();
+      add_out_msg(*client, head.data(), head.size());
+    }
+    backlogged.resize(kept);
+
+    size_t sent = flush_out_msgs(sfd);
+    for (size_t i = 0; i < sent; ++i)
+      out_clients[i]->pending.erase(out_clients[i]->pending.begin());
+
+    if (sent < out_clients.size())
+      break;
+  }
+  clear_out_msgs();
+
+  // Drop clients whose queues were emptied in the last round
+  size_t kept = 0;
+  for (uint64_t key : backlogged)
+    if (ClientInfo *client = clients.find(key); client && !client->pending.empty())
+      backlogged[kept++] = key;
+  backlogged.resize(kept);
+
+  set_writable_interest(sfd, !backlogged.empty());
+}
+
+// The idle timer is not pushed back on every packet: it fires at the old deadline and is
+// rescheduled from lastSeen if the client has been active since.
+static void check_idle(uint64_t key)
+{
+  ClientInfo *client = clients.find(key);
+  if (!client)
+    return;
+
+  const auto idle = TimerWheel::Clock::now() - client->lastSeen;
+  if (idle < client_idle_timeout)
+  {
+    timers.schedule(client_idle_timeout - idle, [key] { check_idle(key); });
+    return;
+  }
+
+  std::cout << "Client timed out: " << format_client_id(key).str << std::endl;
+  clients.erase(key);
+  backlogged.erase(std::remove(backlogged.begin(), backlogged.end(), key), backlogged.end());
+
+  // A running duel just times out without this client
+  std::lock_guard<std::mutex> lock(duel_mutex);
+  if (duel_waiting.key == key && duel_waiting.shard == self)
+    duel_waiting = DuelSlot{ 0, nullptr };
+}
+
+// One duel from task to result. Answers of both players arrive through the mailbox, whichever
+// shard they were received on; only this shard's thread ever resumes the session.
+static Session run_duel(int sfd, DuelSlot first, DuelSlot second, uint64_t id)
+{
+  Mailbox<DuelAnswer> answers(timers);
+  bool inserted = false;
+  duels.insert(id, inserted) = &answers;
+
+  int a = std::uniform_int_distribution<int>(10, 59)(duel_rng);
+  int b = std::uniform_int_distribution<int>(1, 10)(duel_rng);
+  int c = std::uniform_int_distribution<int>(0, 19)(duel_rng);
+  const int correct = a * b - c;
+
+  char task[64];
+  int len = snprintf(task, sizeof(task), "Math Duel Started! Solve: %d * %d - %d = ?", a, b, c);
+  send_to_id(sfd, first, std::string_view(task, len));
+  send_to_id(sfd, second, std::string_view(task, len));
+
+  const TimerWheel::Clock::time_point deadline = TimerWheel::Clock::now() + duel_timeout;
+  uint64_t winner = 0;
+  while (winner == 0)
+  {
+    std::optional<DuelAnswer> answer = co_await answers.receive(deadline - TimerWheel::Clock::now());
+    if (!answer)
+      break;
+    if (answer->value == correct)
+      winner = answer->key;
+  }
+
+  duels.erase(id);
+  {
+    std::lock_guard<std::mutex> lock(duel_mutex);
+    duel_seats.erase(first.key);
+    duel_seats.erase(second.key);
+  }
+
+  if (winner != 0)
+  {
+    char winner_msg[96];
+    len = snprintf(winner_msg, sizeof(winner_msg), "Победитель дуэли: %s", format_client_id(winner).str);
+    broadcast(sfd, std::string_view(winner_msg, len));
+  }
+  else
   {
-    fd_set readSet;
-    FD_ZERO(&readSet);
-    FD_SET(sfd, &readSet);
+    send_to_id(sfd, first, "Время дуэли вышло, победителя нет");
+    send_to_id(sfd, second, "Время дуэли вышло, победителя нет");
+  }
+}
 
-    timeval timeout = { 0, 100000 };
-    select(sfd + 1, &readSet, NULL, NULL, &timeout);
+static void handle_message(int sfd, const sockaddr_in &sin, std::string_view msg)
+{
+  const uint64_t key = client_key(sin);
 
-    if (FD_ISSET(sfd, &readSet))
+  bool inserted = false;
+  ClientInfo &sender = clients.insert(key, inserted);
+  if (inserted)
+  {
+    sender.key = key;
+    sender.addr = sin;
+    timers.schedule(client_idle_timeout, [key] { check_idle(key); });
+  }
+  sender.lastSeen = loop_now;
+
+  if (msg.starts_with("HELLO"))
+  {
+    if (!sender.known)
+    {
+      sender.known = true;
+      std::cout << "New client: " << format_client_id(key).str << " -> " << msg << std::endl;
+    }
+    else
     {
-      constexpr size_t buf_size = 1000;
-      static char buffer[buf_size];
-      memset(buffer, 0, buf_size);
+      std::cout << "Known client again: " << format_client_id(key).str << std::endl;
+    }
+  }
+  else if (msg == "/ping")
+  {
+    // Keepalive from a client that only listens; lastSeen is already refreshed
+  }
+  else if (msg.starts_with("/c "))
+  {
+    broadcast(sfd, msg);
+  }
+  else if (msg == "/mathduel")
+  {
+    std::unique_lock<std::mutex> lock(duel_mutex);
+    if (duel_seats.find(key))
+    {
+      lock.unlock();
+      send_to_client(sfd, sender, "Дуэль уже идёт!");
+      return;
+    }
+    if (duel_waiting.key == 0 || duel_waiting.key == key)
+    {
+      duel_waiting = DuelSlot{ key, self };
+      lock.unlock();
+      send_to_client(sfd, sender, "Ожидаем второго участника...");
+      return;
+    }
 
-      sockaddr_in sin;
-      socklen_t slen = sizeof(sockaddr_in);
-      ssize_t numBytes = recvfrom(sfd, buffer, buf_size - 1, 0, (sockaddr*)&sin, &slen);
+    const DuelSlot first = duel_waiting;
+    const uint64_t id = next_duel_id++;
+    duel_waiting = DuelSlot{ 0, nullptr };
+    bool inserted = false;
+    duel_seats.insert(first.key, inserted) = DuelSeat{ self, id };
+    duel_seats.insert(key, inserted) = DuelSeat{ self, id };
+    lock.unlock();
 
-      if (numBytes > 0)
+    send_to_client(sfd, sender, "Ожидаем второго участника...");
+    run_duel(sfd, first, DuelSlot{ key, self }, id);
+  }
+  else if (msg.starts_with("/ans "))
+  {
+    std::string_view arg = msg.substr(5);
+    int ans = 0;
+    if (std::from_chars(arg.data(), arg.data() + arg.size(), ans).ec != std::errc())
+      return;
+
+    DuelSeat seat;
+    {
+      std::lock_guard<std::mutex> lock(duel_mutex);
+      DuelSeat *found = duel_seats.find(key);
+      if (!found)
+        return;
+      seat = *found;
+    }
+    if (seat.shard == self)
+      answer_duel(seat.duel, DuelAnswer{ key, ans });
+    else
+      post_to_shard(*seat.shard, ShardMessage{ nullptr, key, seat.duel, ans });
+  }
+  else
+  {
+    std::cout << "Message from " << format_client_id(key).str << ": " << msg << std::endl;
+  }
+}
+
+static bool init_shard(Shard &shard, const char *port, bool reuse_port, DgramBackend backend)
+{
+  shard.sfd = create_dgram_socket(nullptr, port, nullptr, reuse_port);
+  if (shard.sfd == -1)
+  {
+    printf("cannot create socket\n");
+    return false;
+  }
+
+  shard.epfd = epoll_create1(0);
+  shard.wakefd = eventfd(0, EFD_NONBLOCK);
+  if (shard.epfd == -1 || shard.wakefd == -1)
+  {
+    printf("cannot create epoll instance\n");
+    return false;
+  }
+
+  shard.receiver = create_dgram_receiver(shard.sfd, backend);
+  shard.recvfd = shard.receiver->event_fd();
+
+  // With io_uring the socket itself is only watched for EPOLLOUT while sends are backlogged
+  epoll_event ev;
+  ev.events = shard.recvfd == shard.sfd ? uint32_t(EPOLLIN) : 0u;
+  ev.data.fd = shard.sfd;
+  epoll_ctl(shard.epfd, EPOLL_CTL_ADD, shard.sfd, &ev);
+  ev.events = EPOLLIN;
+  if (shard.recvfd != shard.sfd)
+  {
+    ev.data.fd = shard.recvfd;
+    epoll_ctl(shard.epfd, EPOLL_CTL_ADD, shard.recvfd, &ev);
+  }
+  ev.data.fd = shard.wakefd;
+  epoll_ctl(shard.epfd, EPOLL_CTL_ADD, shard.wakefd, &ev);
+  return true;
+}
+
+static uint64_t to_ns(const timespec &ts)
+{
+  return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static void record_queue_latency(const timespec &arrival)
+{
+  if (arrival.tv_sec == 0)
+    return;
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  const uint64_t nowNs = to_ns(now), arrivalNs = to_ns(arrival);
+  queue_latency.record(nowNs > arrivalNs ? nowNs - arrivalNs : 0);
+}
+
+static void dump_stats()
+{
+  char name[64];
+  snprintf(name, sizeof(name), "[shard %d] kernel queue latency", self->index);
+  queue_latency.dump(name);
+  queue_latency.reset();
+
+  timers.schedule(stats_interval, dump_stats);
+}
+
+static void run_shard(Shard &shard)
+{
+  self = &shard;
+  duel_rng.seed(uint32_t(time(NULL)) + uint32_t(shard.index));
+  const int sfd = shard.sfd;
+  DgramReceiver &receiver = *shard.receiver;
+
+  Datagram msgs[recv_batch_size];
+
+  constexpr int max_events = 16;
+  epoll_event events[max_events];
+
+  // The wheel is thread_local, so its timerfd is registered by the thread that owns it
+  epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = timers.fd();
+  epoll_ctl(shard.epfd, EPOLL_CTL_ADD, timers.fd(), &ev);
+  timers.schedule(stats_interval, dump_stats);
+
+  while (true)
+  {
+    int numEvents = epoll_wait(shard.epfd, events, max_events, -1);
+    for (int e = 0; e < numEvents; ++e)
+    {
+      if (events[e].data.fd == shard.wakefd)
+      {
+        drain_inbox(sfd);
+        continue;
+      }
+      if (events[e].data.fd == timers.fd())
       {
-        char ip_str[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &(sin.sin_addr), ip_str, INET_ADDRSTRLEN);
-        int port = ntohs(sin.sin_port);
+        timers.on_ready();
+        continue;
+      }
 
-        std::ostringstream oss;
-        oss << ip_str << ":" << port;
-        std::string client_id = oss.str();
-        std::string msg(buffer);
+      if (events[e].events & EPOLLOUT)
+        flush_backlog(sfd);
 
-        clients[client_id] = sin;
+      if (events[e].data.fd != shard.recvfd || !(events[e].events & EPOLLIN))
+        continue;
 
-        if (msg.compare(0, 5, "HELLO") == 0)
-        {
-          if (known_clients.find(client_id) == known_clients.end())
-          {
-            known_clients.insert(client_id);
-            std::cout << "New client: " << client_id << " -> " << msg << std::endl;
-          }
-          else
-          {
-            std::cout << "Known client again: " << client_id << std::endl;
-          }
-        }
-        else if (msg.rfind("/c ", 0) == 0)
-        {
-          std::string to_send = msg;
-          for (const auto& [id, addr] : clients)
-          {
-            sendto(sfd, to_send.c_str(), to_send.size(), 0, (sockaddr*)&addr, sizeof(addr));
-          }
-        }
-        else if (msg == "/mathduel")
-        {
-          if (duel_active)
-          {
-            std::string already = "Дуэль уже идёт!";
-            sendto(sfd, already.c_str(), already.size(), 0, (sockaddr*)&sin, sizeof(sin));
-          }
-          else
-          {
-            duel_queue.insert(client_id);
-            std::string wait = "Ожидаем второго участника...";
-            sendto(sfd, wait.c_str(), wait.size(), 0, (sockaddr*)&sin, sizeof(sin));
-
-            if (duel_queue.size() == 2)
-            {
-              auto it = duel_queue.begin();
-              duel_client1 = *it++;
-              duel_client2 = *it;
-              duel_queue.clear();
-              duel_active = true;
-
-              int a = rand() % 50 + 10;
-              int b = rand() % 10 + 1;
-              int c = rand() % 20;
-              correct_answer = a * b - c;
-
-              std::ostringstream task;
-              task << "Math Duel Started! Solve: " << a << " * " << b << " - " << c << " = ?";
-              std::string task_str = task.str();
-
-              sendto(sfd, task_str.c_str(), task_str.size(), 0, (sockaddr*)&clients[duel_client1], sizeof(sockaddr_in));
-              sendto(sfd, task_str.c_str(), task_str.size(), 0, (sockaddr*)&clients[duel_client2], sizeof(sockaddr_in));
-            }
-          }
-        }
-        else if (msg.rfind("/ans ", 0) == 0 && duel_active)
-        {
-          int ans = std::stoi(msg.substr(5));
-          if ((client_id == duel_client1 || client_id == duel_client2) && ans == correct_answer)
-          {
-            std::string winner_msg = "Победитель дуэли: " + client_id;
-            for (const auto& [id, addr] : clients)
-            {
-              sendto(sfd, winner_msg.c_str(), winner_msg.size(), 0, (sockaddr*)&addr, sizeof(addr));
-            }
-            duel_active = false;
-          }
-        }
-        else
+      // Drain the socket: a burst of datagrams costs one syscall per batch, not per packet
+      int numMsgs = recv_batch_size;
+      while (numMsgs == (int)recv_batch_size && (numMsgs = receiver.receive(msgs, recv_batch_size)) > 0)
+      {
+        loop_now = TimerWheel::Clock::now();
+        for (int i = 0; i < numMsgs; ++i)
         {
-          std::cout << "Message from " << client_id << ": " << msg << std::endl;
+          if (msgs[i].size == 0)
+            continue;
+          record_queue_latency(msgs[i].arrival);
+          handle_message(sfd, *msgs[i].from, std::string_view(msgs[i].data, msgs[i].size));
         }
+        receiver.release();
       }
     }
   }
+}
+
+// Usage: server [num_shards] [--uring]
+int main(int argc, const char **argv)
+{
+  const char *port = "2025";
+  int numShards = 1;
+  DgramBackend backend = DgramBackend::Recvmmsg;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--uring") == 0)
+      backend = DgramBackend::IoUring;
+    else
+      numShards = std::max(1, atoi(argv[i]));
+  }
+
+  for (int i = 0; i < numShards; ++i)
+  {
+    shards.push_back(std::make_unique<Shard>());
+    shards.back()->index = i;
+    if (!init_shard(*shards.back(), port, numShards > 1, backend))
+      return 1;
+  }
+  printf("listening on %d shard(s)!\n", numShards);
+
+  std::vector<std::thread> workers;
+  for (int i = 1; i < numShards; ++i)
+    workers.emplace_back(run_shard, std::ref(*shards[i]));
+  run_shard(*shards[0]);
 
   return 0;
 }
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <optional>
+#include <vector>
+#include "timer_wheel.h"
+
+namespace session_detail
+{
+  constexpr size_t frame_granularity = 64;
+  constexpr size_t pooled_classes = 16; // frames up to 1 KiB are recycled
+
+  // Freed frames of one thread, one free list per size class
+  struct FramePool
+  {
+    std::vector<void*> lists[pooled_classes];
+
+    ~FramePool()
+    {
+      for (std::vector<void*> &list : lists)
+        for (void *frame : list)
+          ::operator delete(frame);
+    }
+  };
+
+  inline thread_local FramePool frame_pool;
+}
+
+// Coroutine running on a shard's event loop. A session starts running when it is called, is
+// resumed by the loop (a timer or a mailbox push) whenever it waits, and frees itself when it
+// returns. Its only memory is the coroutine frame holding its locals; frames are recycled per
+// thread, so a session must finish on the thread it started on.
+class Session
+{
+public:
+  struct promise_type
+  {
+    Session get_return_object() { return Session(); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+
+    static void *operator new(size_t size)
+    {
+      const size_t cls = (size - 1) / session_detail::frame_granularity;
+      if (cls >= session_detail::pooled_classes)
+        return ::operator new(size);
+      std::vector<void*> &list = session_detail::frame_pool.lists[cls];
+      if (list.empty())
+        return ::operator new((cls + 1) * session_detail::frame_granularity);
+      void *frame = list.back();
+      list.pop_back();
+      return frame;
+    }
+
+    static void operator delete(void *ptr, size_t size)
+    {
+      const size_t cls = (size - 1) / session_detail::frame_granularity;
+      if (cls >= session_detail::pooled_classes)
+        ::operator delete(ptr);
+      else
+        session_detail::frame_pool.lists[cls].push_back(ptr);
+    }
+  };
+};
+
+// Bounded queue of values for one waiting session. co_await receive(timeout) yields the next
+// value, or nullopt once the timeout expires with nothing queued.
+template<typename T, size_t Capacity = 4>
+class Mailbox
+{
+public:
+  explicit Mailbox(TimerWheel &timers) : timers(timers) {}
+
+  Mailbox(const Mailbox &) = delete;
+  Mailbox &operator=(const Mailbox &) = delete;
+
+  // Returns false when the mailbox is full. A waiting session is resumed in place and may finish,
+  // destroying the mailbox with its frame, so the caller must not touch the mailbox afterwards.
+  bool push(const T &value)
+  {
+    if (count == Capacity)
+      return false;
+    values[(head + count) % Capacity] = value;
+    ++count;
+    if (waiter)
+      wake();
+    return true;
+  }
+
+  auto receive(TimerWheel::Clock::duration timeout)
+  {
+    struct Awaiter
+    {
+      Mailbox &box;
+      TimerWheel::Clock::duration timeout;
+
+      bool await_ready() const { return box.count > 0 || timeout <= TimerWheel::Clock::duration::zero(); }
+
+      void await_suspend(std::coroutine_handle<> handle)
+      {
+        box.waiter = handle;
+        box.timer = box.timers.schedule(timeout, [mailbox = &box]
+        {
+          mailbox->timer = 0;
+          mailbox->wake();
+        });
+      }
+
+      std::optional<T> await_resume()
+      {
+        if (box.count == 0)
+          return std::nullopt;
+        T value = box.values[box.head];
+        box.head = (box.head + 1) % Capacity;
+        --box.count;
+        return value;
+      }
+    };
+    return Awaiter{ *this, timeout };
+  }
+
+private:
+  void wake()
+  {
+    if (timer)
+      timers.cancel(timer);
+    timer = 0;
+    std::coroutine_handle<> handle = waiter;
+    waiter = nullptr;
+    handle.resume();
+  }
+
+  TimerWheel &timers;
+  std::coroutine_handle<> waiter;
+  TimerWheel::TimerId timer = 0;
+  T values[Capacity];
+  size_t head = 0;
+  size_t count = 0;
+};
@@ -4,13 +4,14 @@
 #include <netdb.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
 #include <stdio.h>
 
 #include "socket_tools.h"
 
 // Adaptation of linux man page: https://linux.die.net/man/3/getaddrinfo
-static int get_dgram_socket(addrinfo *addr, bool should_bind, addrinfo *res_addr)
+static int get_dgram_socket(addrinfo *addr, bool should_bind, bool reuse_port, addrinfo *res_addr)
 {
   for (addrinfo *ptr = addr; ptr != nullptr; ptr = ptr->ai_next)
   {
@@ -24,6 +25,12 @@ static int get_dgram_socket(addrinfo *addr, bool should_bind, addrinfo *res_addr
 
     int trueVal = 1;
     setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &trueVal, sizeof(int));
+    setsockopt(sfd, SOL_SOCKET, SO_TIMESTAMPNS, &trueVal, sizeof(int));
+    if (reuse_port && setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &trueVal, sizeof(int)) != 0)
+    {
+      close(sfd);
+      continue;
+    }
 
     if (res_addr)
       *res_addr = *ptr;
@@ -38,7 +45,7 @@ static int get_dgram_socket(addrinfo *addr, bool should_bind, addrinfo *res_addr
   return -1;
 }
 
-int create_dgram_socket(const char *address, const char *port, addrinfo *res_addr)
+int create_dgram_socket(const char *address, const char *port, addrinfo *res_addr, bool reuse_port)
 {
   addrinfo hints;
   memset(&hints, 0, sizeof(addrinfo));
@@ -54,9 +61,110 @@ int create_dgram_socket(const char *address, const char *port, addrinfo *res_add
   if (getaddrinfo(address, port, &hints, &result) != 0)
     return -1;
 
-  int sfd = get_dgram_socket(result, isListener, res_addr);
+  int sfd = get_dgram_socket(result, isListener, reuse_port, res_addr);
 
   //freeaddrinfo(result);
   return sfd;
 }
 
+
+void init_recv_batch(RecvBatch &batch)
+{
+  memset(batch.msgs, 0, sizeof(batch.msgs));
+  for (size_t i = 0; i < recv_batch_size; ++i)
+  {
+    batch.iovs[i].iov_base = batch.slots[i];
+    batch.iovs[i].iov_len = recv_slot_size - 1;
+
+    msghdr &hdr = batch.msgs[i].msg_hdr;
+    hdr.msg_iov = &batch.iovs[i];
+    hdr.msg_iovlen = 1;
+    hdr.msg_name = &batch.addrs[i];
+    hdr.msg_namelen = sizeof(sockaddr_in);
+    hdr.msg_control = batch.controls[i];
+    hdr.msg_controllen = recv_control_size;
+  }
+}
+
+int recv_batch(int sfd, RecvBatch &batch, size_t max)
+{
+  int n = recvmmsg(sfd, batch.msgs, max < recv_batch_size ? max : recv_batch_size, MSG_DONTWAIT, nullptr);
+  if (n < 0)
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+
+  for (int i = 0; i < n; ++i)
+  {
+    batch.slots[i][batch.msgs[i].msg_len] = '\0';
+    batch.arrivals[i] = arrival_time(batch.msgs[i].msg_hdr);
+    // recvmmsg overwrites the address and control lengths, restore them for the next call
+    batch.msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    batch.msgs[i].msg_hdr.msg_controllen = recv_control_size;
+  }
+  return n;
+}
+
+timespec arrival_time(const msghdr &hdr)
+{
+  for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&hdr), cmsg))
+  {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+    {
+      timespec ts;
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      return ts;
+    }
+  }
+  return timespec{ 0, 0 };
+}
+
+int send_batch(int sfd, mmsghdr *msgs, size_t count)
+{
+  size_t sent = 0;
+  while (sent < count)
+  {
+    int n = sendmmsg(sfd, msgs + sent, count - sent, MSG_DONTWAIT);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      // Drop the message that failed permanently (e.g. unreachable peer) and go on with the rest
+      ++sent;
+      continue;
+    }
+    sent += n;
+  }
+  return sent;
+}
+
+class RecvmmsgReceiver : public DgramReceiver
+{
+public:
+  explicit RecvmmsgReceiver(int sfd) : sfd(sfd) { init_recv_batch(batch); }
+
+  int event_fd() const override { return sfd; }
+
+  int receive(Datagram *out, size_t max) override
+  {
+    int n = recv_batch(sfd, batch, max);
+    for (int i = 0; i < n; ++i)
+      out[i] = Datagram{ &batch.addrs[i], batch.slots[i], batch.msgs[i].msg_len, batch.arrivals[i] };
+    return n;
+  }
+
+private:
+  int sfd;
+  RecvBatch batch;
+};
+
+std::unique_ptr<DgramReceiver> create_dgram_receiver(int sfd, DgramBackend backend)
+{
+  if (backend == DgramBackend::IoUring)
+  {
+    if (std::unique_ptr<DgramReceiver> receiver = create_uring_receiver(sfd))
+      return receiver;
+    printf("io_uring is unavailable, falling back to recvmmsg\n");
+  }
+  return std::make_unique<RecvmmsgReceiver>(sfd);
+}
@@ -1,5 +1,76 @@
 #pragma once
 
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <ctime>
+#include <cstddef>
+#include <memory>
+
 struct addrinfo;
 
-int create_dgram_socket(const char *address, const char *port, addrinfo *res_addr);
+// Sockets are created with SO_TIMESTAMPNS, so every datagram carries its kernel arrival time.
+// With reuse_port several listeners can bind the same port and the kernel spreads
+// incoming flows between them by address hash (SO_REUSEPORT).
+int create_dgram_socket(const char *address, const char *port, addrinfo *res_addr, bool reuse_port = false);
+
+// Pool of reusable receive slots, drained from a socket with one recvmmsg call.
+// Every received datagram is null-terminated in place, so slots never need clearing.
+constexpr size_t recv_batch_size = 64;
+constexpr size_t recv_slot_size = 1000;
+constexpr size_t recv_control_size = CMSG_SPACE(sizeof(timespec));
+
+struct RecvBatch
+{
+  mmsghdr msgs[recv_batch_size];
+  iovec iovs[recv_batch_size];
+  sockaddr_in addrs[recv_batch_size];
+  timespec arrivals[recv_batch_size];
+  alignas(cmsghdr) char controls[recv_batch_size][recv_control_size];
+  char slots[recv_batch_size][recv_slot_size];
+};
+
+void init_recv_batch(RecvBatch &batch);
+// Returns number of datagrams received, 0 when the socket is drained, -1 on error.
+int recv_batch(int sfd, RecvBatch &batch, size_t max = recv_batch_size);
+
+// Kernel arrival time (CLOCK_REALTIME) from the SCM_TIMESTAMPNS control message, zero if absent.
+timespec arrival_time(const msghdr &hdr);
+
+// Sends as many of the prepared messages as the kernel accepts, retrying on partial sendmmsg.
+// Returns the number of messages sent; the rest hit EAGAIN and should be retried on EPOLLOUT.
+int send_batch(int sfd, mmsghdr *msgs, size_t count);
+
+// A received datagram. data points into the receiver's buffers and stays valid until release().
+struct Datagram
+{
+  const sockaddr_in *from;
+  const char *data;
+  size_t size;
+  timespec arrival;
+};
+
+enum class DgramBackend
+{
+  Recvmmsg, // readiness through epoll/select, datagrams drained with recvmmsg
+  IoUring   // multishot recvmsg into a registered buffer ring, no syscall per batch
+};
+
+class DgramReceiver
+{
+public:
+  virtual ~DgramReceiver() = default;
+
+  // Descriptor that becomes readable while datagrams are waiting, to be watched with epoll/select.
+  virtual int event_fd() const = 0;
+  // Fills up to max datagrams and returns how many, 0 when nothing is left, -1 on error.
+  virtual int receive(Datagram *out, size_t max) = 0;
+  // Hands the buffers of the last receive() back to the receiver.
+  virtual void release() {}
+};
+
+// Falls back to the recvmmsg receiver when io_uring is unavailable on this kernel.
+std::unique_ptr<DgramReceiver> create_dgram_receiver(int sfd, DgramBackend backend);
+
+// Defined in socket_uring.cpp, returns nullptr when the kernel lacks the required io_uring features.
+std::unique_ptr<DgramReceiver> create_uring_receiver(int sfd);
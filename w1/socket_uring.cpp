@@ -0,0 +1,301 @@
+// io_uring receive backend for socket_tools: one multishot recvmsg stays armed on the socket and
+// the kernel writes every datagram into a buffer ring registered up front. Completions are
+// signalled through an eventfd, so callers keep their epoll/select loop and reap datagrams
+// straight from the completion queue without any syscall per datagram.
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+#include "socket_tools.h"
+
+static int io_uring_setup(unsigned entries, io_uring_params *params)
+{
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// A completion that ends the multishot request without delivering a buffer. Running out of buffers
+// is recovered from by re-arming; anything else (e.g. EINVAL from a kernel without multishot
+// recvmsg) would fail again on every re-arm.
+static bool request_failed(const io_uring_cqe &cqe)
+{
+  return !(cqe.flags & (IORING_CQE_F_MORE | IORING_CQE_F_BUFFER)) && cqe.res < 0 && cqe.res != -ENOBUFS;
+}
+
+template<typename T>
+static T load_acquire(const T *ptr)
+{
+  return std::atomic_ref<T>(*const_cast<T*>(ptr)).load(std::memory_order_acquire);
+}
+
+template<typename T>
+static void store_release(T *ptr, T value)
+{
+  std::atomic_ref<T>(*ptr).store(value, std::memory_order_release);
+}
+
+class UringReceiver : public DgramReceiver
+{
+public:
+  static constexpr unsigned ring_entries = 64;
+  static constexpr unsigned num_buffers = 256; // power of two, required by the buffer ring
+  static constexpr unsigned buffer_size = 2048;
+  static constexpr uint16_t buffer_group = 0;
+
+  explicit UringReceiver(int sfd) : sfd(sfd) {}
+
+  ~UringReceiver() override
+  {
+    if (ringFd != -1)
+      close(ringFd);
+    if (eventFd != -1)
+      close(eventFd);
+    if (ringMem != MAP_FAILED)
+      munmap(ringMem, ringMemSize);
+    if (sqesMem != MAP_FAILED)
+      munmap(sqesMem, sqesMemSize);
+    if (bufRing != MAP_FAILED)
+      munmap(bufRing, bufRingSize);
+  }
+
+  bool init()
+  {
+    // Every buffer can hold one completion, so a full burst fits the CQ without overflowing
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = num_buffers * 2;
+    ringFd = io_uring_setup(ring_entries, &params);
+    if (ringFd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP))
+      return false;
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ringMemSize = sqSize > cqSize ? sqSize : cqSize;
+    ringMem = mmap(nullptr, ringMemSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    sqesMemSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqesMem = mmap(nullptr, sqesMemSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (ringMem == MAP_FAILED || sqesMem == MAP_FAILED)
+      return false;
+
+    char *ring = (char*)ringMem;
+    sqTail = (unsigned*)(ring + params.sq_off.tail);
+    sqFlags = (unsigned*)(ring + params.sq_off.flags);
+    sqMask = *(unsigned*)(ring + params.sq_off.ring_mask);
+    sqArray = (unsigned*)(ring + params.sq_off.array);
+    cqHead = (unsigned*)(ring + params.cq_off.head);
+    cqTail = (unsigned*)(ring + params.cq_off.tail);
+    cqMask = *(unsigned*)(ring + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(ring + params.cq_off.cqes);
+    sqes = (io_uring_sqe*)sqesMem;
+
+    // Multishot recvmsg is newer than the opcode, so passing this is checked again on arming below
+    std::vector<uint64_t> probeMem((sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op) + 7) / 8, 0);
+    io_uring_probe *probe = (io_uring_probe*)probeMem.data();
+    if (io_uring_register(ringFd, IORING_REGISTER_PROBE, probe, 256) != 0 || probe->last_op < IORING_OP_RECVMSG ||
+        !(probe->ops[IORING_OP_RECVMSG].flags & IO_URING_OP_SUPPORTED))
+      return false;
+
+    eventFd = eventfd(0, EFD_NONBLOCK);
+    if (eventFd == -1 || io_uring_register(ringFd, IORING_REGISTER_EVENTFD, &eventFd, 1) != 0)
+      return false;
+
+    // Buffer ring shared with the kernel: entries describe free buffers, tail publishes them
+    bufRingSize = num_buffers * sizeof(io_uring_buf);
+    bufRing = mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufRing == MAP_FAILED)
+      return false;
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)bufRing;
+    reg.ring_entries = num_buffers;
+    reg.bgid = buffer_group;
+    if (io_uring_register(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+      return false;
+
+    buffers.resize(size_t(num_buffers) * buffer_size);
+    for (unsigned bid = 0; bid < num_buffers; ++bid)
+      add_buffer(bid);
+    publish_buffers();
+
+    memset(&msgTemplate, 0, sizeof(msgTemplate));
+    msgTemplate.msg_namelen = sizeof(sockaddr_in);
+    msgTemplate.msg_controllen = recv_control_size;
+
+    if (!arm_recv())
+      return false;
+    // A request the kernel does not support completes with an error during the submit itself
+    unsigned tail = load_acquire(cqTail);
+    for (unsigned head = *cqHead; head != tail; ++head)
+      if (request_failed(cqes[head & cqMask]))
+        return false;
+    return true;
+  }
+
+  int event_fd() const override { return eventFd; }
+
+  int receive(Datagram *out, size_t max) override
+  {
+    uint64_t counter = 0;
+    read(eventFd, &counter, sizeof(counter));
+    if (failed)
+      return -1;
+
+    // Completions the kernel could not post are only flushed into the CQ by io_uring_enter
+    if (load_acquire(sqFlags) & IORING_SQ_CQ_OVERFLOW)
+      io_uring_enter(ringFd, 0, 0, IORING_ENTER_GETEVENTS);
+
+    size_t count = 0;
+    unsigned head = *cqHead;
+    unsigned tail = load_acquire(cqTail);
+    while (head != tail && count < max)
+    {
+      const io_uring_cqe &cqe = cqes[head & cqMask];
+      ++head;
+
+      // A multishot request that stops (e.g. buffers ran out) has to be submitted again
+      if (!(cqe.flags & IORING_CQE_F_MORE))
+        needsRearm = true;
+      // Re-arming a request that cannot work would spin on the eventfd forever
+      if (request_failed(cqe))
+        failed = true;
+      if (!(cqe.flags & IORING_CQE_F_BUFFER))
+        continue;
+
+      const uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+      inUse.push_back(bid);
+      if (cqe.res < 0)
+        continue;
+
+      const char *buf = &buffers[size_t(bid) * buffer_size];
+      const io_uring_recvmsg_out *hdr = (const io_uring_recvmsg_out*)buf;
+      const size_t payloadOffset = sizeof(io_uring_recvmsg_out) + msgTemplate.msg_namelen + msgTemplate.msg_controllen;
+      if (size_t(cqe.res) < payloadOffset || hdr->namelen < sizeof(sockaddr_in))
+        continue;
+      const size_t available = size_t(cqe.res) - payloadOffset;
+
+      // Layout of a multishot buffer: recvmsg_out header, name area, control area, payload
+      msghdr control;
+      memset(&control, 0, sizeof(control));
+      control.msg_control = (void*)(buf + sizeof(io_uring_recvmsg_out) + msgTemplate.msg_namelen);
+      control.msg_controllen = hdr->controllen;
+
+      out[count++] = Datagram{ (const sockaddr_in*)(buf + sizeof(io_uring_recvmsg_out)),
+                               buf + payloadOffset,
+                               hdr->payloadlen < available ? hdr->payloadlen : available,
+                               arrival_time(control) };
+    }
+    store_release(cqHead, head);
+
+    if (failed)
+    {
+      needsRearm = false;
+      return -1;
+    }
+    if (needsRearm && inUse.empty() && !arm_recv())
+      return -1;
+    return (int)count;
+  }
+
+  void release() override
+  {
+    for (uint16_t bid : inUse)
+      add_buffer(bid);
+    inUse.clear();
+    publish_buffers();
+
+    // Re-arm only after buffers are back, otherwise the request would fail with ENOBUFS again
+    if (needsRearm)
+      arm_recv();
+  }
+
+private:
+  void add_buffer(uint16_t bid)
+  {
+    // Not ringHdr->bufs: the header's flex array sits behind an empty struct that takes space in C++
+    io_uring_buf &entry = ((io_uring_buf*)bufRing)[bufTail & (num_buffers - 1)];
+    entry.addr = (uint64_t)&buffers[size_t(bid) * buffer_size];
+    entry.len = buffer_size;
+    entry.bid = bid;
+    ++bufTail;
+  }
+
+  void publish_buffers()
+  {
+    io_uring_buf_ring *ringHdr = (io_uring_buf_ring*)bufRing;
+    store_release(&ringHdr->tail, bufTail);
+  }
+
+  bool arm_recv()
+  {
+    unsigned tail = *sqTail;
+    unsigned idx = tail & sqMask;
+    io_uring_sqe &sqe = sqes[idx];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_RECVMSG;
+    sqe.fd = sfd;
+    sqe.addr = (uint64_t)&msgTemplate;
+    sqe.len = 1;
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = buffer_group;
+    sqArray[idx] = idx;
+    store_release(sqTail, tail + 1);
+
+    needsRearm = false;
+    return io_uring_enter(ringFd, 1, 0, 0) == 1;
+  }
+
+  int sfd;
+  int ringFd = -1;
+  int eventFd = -1;
+
+  void *ringMem = MAP_FAILED;
+  size_t ringMemSize = 0;
+  void *sqesMem = MAP_FAILED;
+  size_t sqesMemSize = 0;
+  void *bufRing = MAP_FAILED;
+  size_t bufRingSize = 0;
+
+  unsigned *sqTail = nullptr;
+  unsigned *sqFlags = nullptr;
+  unsigned sqMask = 0;
+  unsigned *sqArray = nullptr;
+  io_uring_sqe *sqes = nullptr;
+  unsigned *cqHead = nullptr;
+  unsigned *cqTail = nullptr;
+  unsigned cqMask = 0;
+  io_uring_cqe *cqes = nullptr;
+
+  msghdr msgTemplate;
+  std::vector<char> buffers;
+  std::vector<uint16_t> inUse;
+  uint16_t bufTail = 0;
+  bool needsRearm = false;
+  bool failed = false;   // the request was rejected; receive() keeps returning -1
+};
+
+std::unique_ptr<DgramReceiver> create_uring_receiver(int sfd)
+{
+  std::unique_ptr<UringReceiver> receiver = std::make_unique<UringReceiver>(sfd);
+  if (!receiver->init())
+    return nullptr;
+  return receiver;
+}
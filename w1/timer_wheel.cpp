@@ -0,0 +1,223 @@
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <ctime>
+
+#include "timer_wheel.h"
+
+TimerWheel::TimerWheel() : start(Clock::now())
+{
+  timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  for (uint32_t &head : heads)
+    head = nil;
+}
+
+TimerWheel::~TimerWheel()
+{
+  if (timerFd != -1)
+    close(timerFd);
+}
+
+uint64_t TimerWheel::now_tick() const
+{
+  return (Clock::now() - start) / tick;
+}
+
+TimerWheel::TimerId TimerWheel::schedule(Clock::duration delay, std::function<void()> callback)
+{
+  uint32_t idx;
+  if (!freeNodes.empty())
+  {
+    idx = freeNodes.back();
+    freeNodes.pop_back();
+  }
+  else
+  {
+    idx = nodes.size();
+    nodes.emplace_back();
+  }
+
+  // Round up so a timer never fires early, and never into the tick being processed
+  const uint64_t deadline = (Clock::now() - start + delay + tick - Clock::duration(1)) / tick;
+  Node &node = nodes[idx];
+  node.expires = deadline > current ? deadline : current + 1;
+  node.callback = std::move(callback);
+  place(idx);
+  ++active;
+
+  if (node.expires < armedTick)
+    rearm();
+  return (uint64_t(node.generation) << 32) | (idx + 1);
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+  const uint32_t idx = uint32_t(id & 0xffffffff) - 1;
+  if (id == 0 || idx >= nodes.size())
+    return false;
+  Node &node = nodes[idx];
+  if (node.slot == nil || node.generation != uint32_t(id >> 32))
+    return false;
+
+  unlink(idx);
+  free_node(idx);
+  // The timerfd is left armed: a spurious wakeup is cheaper than a syscall per cancel
+  return true;
+}
+
+void TimerWheel::place(uint32_t idx)
+{
+  const uint64_t expires = nodes[idx].expires;
+  uint64_t delta = expires > current ? expires - current : 0;
+
+  for (int level = 0; level < num_levels; ++level)
+  {
+    if (delta < (uint64_t(1) << (level_bits * (level + 1))) || level == num_levels - 1)
+    {
+      uint64_t slotTick = expires;
+      // Beyond the wheel's range a timer waits in the farthest slot and is re-placed on cascade
+      if (level == num_levels - 1 && delta >= (uint64_t(1) << (level_bits * num_levels)))
+        slotTick = current + (uint64_t(1) << (level_bits * num_levels)) - 1;
+      const uint32_t slot = (slotTick >> (level_bits * level)) & (slots_per_level - 1);
+      link(idx, level * slots_per_level + slot);
+      return;
+    }
+  }
+}
+
+void TimerWheel::link(uint32_t idx, uint32_t slot)
+{
+  Node &node = nodes[idx];
+  node.slot = slot;
+  node.prev = nil;
+  node.next = heads[slot];
+  if (node.next != nil)
+    nodes[node.next].prev = idx;
+  heads[slot] = idx;
+  occupied[slot / slots_per_level] |= uint64_t(1) << (slot % slots_per_level);
+}
+
+void TimerWheel::unlink(uint32_t idx)
+{
+  Node &node = nodes[idx];
+  if (node.prev != nil)
+    nodes[node.prev].next = node.next;
+  else
+    heads[node.slot] = node.next;
+  if (node.next != nil)
+    nodes[node.next].prev = node.prev;
+  if (heads[node.slot] == nil)
+    occupied[node.slot / slots_per_level] &= ~(uint64_t(1) << (node.slot % slots_per_level));
+  node.slot = nil;
+}
+
+void TimerWheel::free_node(uint32_t idx)
+{
+  Node &node = nodes[idx];
+  node.callback = nullptr;
+  ++node.generation;
+  freeNodes.push_back(idx);
+  --active;
+}
+
+// Moves every timer of the level's current slot one level down (or straight to level 0)
+void TimerWheel::cascade(int level)
+{
+  const uint32_t slot = level * slots_per_level + ((current >> (level_bits * level)) & (slots_per_level - 1));
+  uint32_t idx = heads[slot];
+  heads[slot] = nil;
+  occupied[level] &= ~(uint64_t(1) << (slot % slots_per_level));
+  while (idx != nil)
+  {
+    const uint32_t next = nodes[idx].next;
+    place(idx);
+    idx = next;
+  }
+}
+
+// First tick after current that needs processing: an occupied level-0 slot, or the next
+// level-0 wrap if coarser levels hold timers that may cascade down there.
+uint64_t TimerWheel::next_event_tick() const
+{
+  if (active == 0)
+    return no_tick;
+
+  bool coarse = false;
+  for (int level = 1; level < num_levels; ++level)
+    coarse |= occupied[level] != 0;
+
+  const uint64_t wrap = (current | (slots_per_level - 1)) + 1;
+  if (occupied[0])
+  {
+    // Rotate the bitmap so bit 0 is the slot right after current
+    const uint32_t shift = (current + 1) & (slots_per_level - 1);
+    const uint64_t rotated = shift ? (occupied[0] >> shift) | (occupied[0] << (slots_per_level - shift)) : occupied[0];
+    const uint64_t next = current + 1 + __builtin_ctzll(rotated);
+    if (next <= wrap || !coarse)
+      return next;
+  }
+  return wrap;
+}
+
+void TimerWheel::advance(uint64_t target)
+{
+  while (current < target)
+  {
+    const uint64_t next = next_event_tick();
+    if (next > target)
+    {
+      // Nothing can become due before target; wrap points in between hold no timers either
+      current = target;
+      break;
+    }
+    current = next;
+
+    if ((current & (slots_per_level - 1)) == 0)
+    {
+      // Cascade from the coarsest level whose index wrapped as well
+      int top = 1;
+      while (top < num_levels - 1 && ((current >> (level_bits * top)) & (slots_per_level - 1)) == 0)
+        ++top;
+      for (int level = top; level >= 1; --level)
+        cascade(level);
+    }
+
+    const uint32_t slot = current & (slots_per_level - 1);
+    while (heads[slot] != nil)
+    {
+      const uint32_t idx = heads[slot];
+      unlink(idx);
+      std::function<void()> callback = std::move(nodes[idx].callback);
+      free_node(idx);
+      callback();
+    }
+  }
+}
+
+void TimerWheel::on_ready()
+{
+  uint64_t expirations = 0;
+  read(timerFd, &expirations, sizeof(expirations));
+
+  armedTick = no_tick;
+  advance(now_tick());
+  rearm();
+}
+
+void TimerWheel::rearm()
+{
+  const uint64_t next = next_event_tick();
+  armedTick = next;
+
+  itimerspec spec = {};
+  if (next != no_tick)
+  {
+    // Absolute deadline on CLOCK_MONOTONIC, which is what steady_clock reads on Linux
+    const auto when = (start + next * tick).time_since_epoch();
+    const auto secs = std::chrono::duration_cast<std::chrono::seconds>(when);
+    spec.it_value.tv_sec = secs.count();
+    spec.it_value.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(when - secs).count();
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+      spec.it_value.tv_nsec = 1;
+  }
+  timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
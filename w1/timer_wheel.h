@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Hierarchical timer wheel driven by a timerfd. Scheduling and cancelling are O(1): a timer is
+// linked into a slot picked from its expiry tick, and timers in the coarser levels cascade down
+// as the wheel turns. The timerfd is armed one-shot for the next tick that has work and disarmed
+// when no timers are pending, so an idle wheel causes no wakeups at all.
+class TimerWheel
+{
+public:
+  using Clock = std::chrono::steady_clock;
+  using TimerId = uint64_t; // 0 is never a valid id
+
+  static constexpr std::chrono::microseconds tick = std::chrono::microseconds(100);
+  static constexpr int level_bits = 6;
+  static constexpr int num_levels = 5; // 64^5 ticks of 100us: a bit more than 29 hours
+  static constexpr uint32_t slots_per_level = 1u << level_bits;
+
+  TimerWheel();
+  ~TimerWheel();
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  // Descriptor to watch with epoll; call on_ready() when it becomes readable.
+  int fd() const { return timerFd; }
+
+  TimerId schedule(Clock::duration delay, std::function<void()> callback);
+  bool cancel(TimerId id);
+
+  // Runs every timer that is due and re-arms the timerfd for the next one.
+  void on_ready();
+
+  size_t size() const { return active; }
+
+private:
+  static constexpr uint32_t nil = UINT32_MAX;
+  static constexpr uint64_t no_tick = UINT64_MAX;
+
+  struct Node
+  {
+    uint64_t expires = 0;
+    uint32_t prev = nil;
+    uint32_t next = nil;
+    uint32_t generation = 0;
+    uint32_t slot = nil; // index into heads, nil while the node is free
+    std::function<void()> callback;
+  };
+
+  uint64_t now_tick() const;
+  void place(uint32_t idx);
+  void link(uint32_t idx, uint32_t slot);
+  void unlink(uint32_t idx);
+  void free_node(uint32_t idx);
+  void cascade(int level);
+  void advance(uint64_t target);
+  uint64_t next_event_tick() const;
+  void rearm();
+
+  int timerFd = -1;
+  Clock::time_point start;
+  uint64_t current = 0;
+  uint64_t armedTick = no_tick;
+  size_t active = 0;
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> freeNodes;
+  uint32_t heads[num_levels * slots_per_level];
+  uint64_t occupied[num_levels] = {};
+};
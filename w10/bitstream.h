@@ -0,0 +1,169 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <stdexcept>
+#include <string>
+
+// Worst-case LEB128 size of a value with the given number of significant bits
+constexpr size_t varint_max_bytes(size_t bits)
+{
+    return (bits + 6) / 7;
+}
+
+// Bits are packed LSB first. Writes collect in a 64-bit scratch register that goes to the
+// buffer a whole word at a time; reads load up to 64 bits with one unaligned word load.
+// Byte-sized data (Write<T>, strings) is aligned first and copied with memcpy.
+//
+// By default the stream owns a growing buffer. WrapStorage instead writes into memory the
+// caller provides, e.g. the data of an ENetPacket created at the message's maximum size, so a
+// message is serialized in place without a second allocation or copy.
+class BitStream
+{
+private:
+    std::vector<std::uint8_t> buffer;
+    std::uint8_t* m_Storage = nullptr;  // caller's memory, used instead of buffer when set
+    size_t m_StorageSize = 0;
+    size_t m_StorageCapacity = 0;
+    size_t m_WritePose = 0;
+    size_t m_ReadPose = 0;
+    uint64_t m_Scratch = 0;      // the last m_ScratchBits written bits, not yet in the buffer
+    uint32_t m_ScratchBits = 0;  // always < 64
+
+    std::uint8_t* Data();
+    size_t Size() const;
+    void Grow(size_t size);
+    void FlushWord();
+
+public:
+    BitStream();
+    BitStream(const std::uint8_t* data, size_t size);
+    // Writes go to storage and throw std::length_error past capacity
+    static BitStream WrapStorage(std::uint8_t* storage, size_t capacity);
+
+    void WriteBit(bool value);
+    bool ReadBit();
+
+    // Up to 64 bits, the low bitCount bits of value
+    void WriteBits(uint64_t value, uint8_t bitCount);
+    uint64_t ReadBits(uint8_t bitCount);
+
+    void WriteBytes(const void* data, size_t size);
+    void ReadBytes(void* data, size_t size);
+
+    void AlignWrite();
+    void AlignRead();
+
+    template<typename T>
+    void Write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Type must be trivially copyable");
+        WriteBytes(&value, sizeof(T));
+    }
+
+    template<typename T>
+    void Read(T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Type must be trivially copyable");
+        ReadBytes(&value, sizeof(T));
+    }
+
+    void Write(const std::string& value);
+    void Read(std::string& value);
+
+    // LEB128: 7 bits per byte, low groups first, the top bit set on all groups but the last.
+    // The bytes go through WriteBits, so they need no alignment.
+    void WriteVarUint(uint64_t value);
+    uint64_t ReadVarUint();
+    // Zigzag-mapped (0, -1, 1, -2, ...) so that small negative values stay short
+    void WriteVarInt(int64_t value);
+    int64_t ReadVarInt();
+    // value - min in exactly bit_width(max - min) bits; throws std::out_of_range outside [min, max]
+    void WriteBounded(int64_t value, int64_t min, int64_t max);
+    int64_t ReadBounded(int64_t min, int64_t max);
+
+    // Q is a compile-time quantizer providing num_bits, pack(float) and unpack(code); the value
+    // takes exactly Q::num_bits bits
+    template<typename Q>
+    void WriteQuantized(float value)
+    {
+        WriteBits(Q::pack(value), Q::num_bits);
+    }
+
+    template<typename Q>
+    float ReadQuantized()
+    {
+        return Q::unpack(uint32_t(ReadBits(Q::num_bits)));
+    }
+
+    void WriteBoolArray(const std::vector<bool>& bools);
+    std::vector<bool> ReadBoolArray();
+
+    // Moves bits still in the scratch register into the buffer or storage
+    void FlushBits();
+
+    // Flushes first
+    const std::uint8_t* GetData();
+    size_t GetSizeBytes() const;
+    size_t GetSizeBits() const;
+    size_t GetBitsLeft() const;
+
+    void ResetWrite();
+    void ResetRead();
+    void Clear();
+};
+
+// Read-only view over bytes owned by someone else, typically a received ENetPacket, which must
+// outlive the reader. Same format and Read API as BitStream, without copying the payload.
+//
+// Meant for untrusted input, so malformed data never throws: a read past the end, an overlong
+// varint or an out-of-range bounded value sets a sticky error flag and reads as zero, and every
+// read after it does too. Decode the whole message, then check HasError() once and drop it.
+class BitReader
+{
+private:
+    const std::uint8_t* m_Data;
+    size_t m_Size;
+    size_t m_ReadPose = 0;
+    bool m_Error = false;
+
+public:
+    BitReader(const std::uint8_t* data, size_t size);
+
+    bool HasError() const;
+    // Marks the data malformed and moves to its end, so nothing more can be read
+    void SetError();
+
+    bool ReadBit();
+    uint64_t ReadBits(uint8_t bitCount);
+    void ReadBytes(void* data, size_t size);
+    void AlignRead();
+
+    template<typename T>
+    void Read(T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Type must be trivially copyable");
+        ReadBytes(&value, sizeof(T));
+    }
+
+    void Read(std::string& value);
+    uint64_t ReadVarUint();
+    int64_t ReadVarInt();
+    int64_t ReadBounded(int64_t min, int64_t max);
+    std::vector<bool> ReadBoolArray();
+
+    template<typename Q>
+    float ReadQuantized()
+    {
+        return Q::unpack(uint32_t(ReadBits(Q::num_bits)));
+    }
+
+    const std::uint8_t* GetData() const;
+    size_t GetSizeBytes() const;
+    size_t GetSizeBits() const;
+    size_t GetBitsLeft() const;
+
+    // Clears the error flag as well
+    void ResetRead();
+};
@@ -16,7 +16,8 @@ static uint16_t my_entity = invalid_entity;
 void on_new_entity_packet(ENetPacket *packet)
 {
   Entity newEntity;
-  deserialize_new_entity(packet, newEntity);
+  if (!deserialize_new_entity(packet, newEntity))
+    return;
   // TODO: Direct adressing, of course!
   for (const Entity &e : entities)
     if (e.eid == newEntity.eid)
@@ -26,14 +27,16 @@ void on_new_entity_packet(ENetPacket *packet)
 
 void on_set_controlled_entity(ENetPacket *packet)
 {
-  deserialize_set_controlled_entity(packet, my_entity);
+  if (!deserialize_set_controlled_entity(packet, my_entity))
+    return;
 }
 
 void on_snapshot(ENetPacket *packet)
 {
   uint16_t eid = invalid_entity;
   float x = 0.f; float y = 0.f; float ori = 0.f;
-  deserialize_snapshot(packet, eid, x, y, ori);
+  if (!deserialize_snapshot(packet, eid, x, y, ori))
+    return;
   // TODO: Direct adressing, of course!
   for (Entity &e : entities)
     if (e.eid == eid)
@@ -46,7 +49,8 @@ void on_snapshot(ENetPacket *packet)
 
 void on_key(ENetPacket *packet)
 {
-  deserialize_and_set_key(packet);
+  if (!deserialize_and_set_key(packet))
+    return;
 }
 
 int main(int argc, const char **argv)
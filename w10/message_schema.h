@@ -0,0 +1,178 @@
+#pragma once
+#include <enet/enet.h>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include "bitstream.h"
+
+// Compile-time message schemas. A message is a plain struct plus a schema listing its fields
+// once, in wire order, each with an encoding:
+//
+//   struct ScoreUpdate { uint16_t eid; int score; };
+//   using ScoreUpdateSchema = MessageSchema<ScoreUpdate, E_SERVER_TO_CLIENT_SCORE_UPDATE,
+//                                           Field<&ScoreUpdate::eid, VarUint>,
+//                                           Field<&ScoreUpdate::score, VarInt>>;
+//
+// The encoder, the decoder and the worst-case size (max_bytes) are all generated from that
+// list at compile time. Every message starts with its type byte.
+
+// Field encodings
+struct Raw  // the value's bytes, byte aligned
+{
+  static constexpr bool aligned = true;
+  template<typename T> static constexpr size_t max_bits = sizeof(T) * 8;
+
+  template<typename T> static void write(BitStream &bs, const T &value) { bs.Write<T>(value); }
+  template<typename Reader, typename T> static void read(Reader &bs, T &value) { bs.template Read<T>(value); }
+};
+
+struct VarUint  // LEB128
+{
+  static constexpr bool aligned = false;
+  template<typename T> static constexpr size_t max_bits = varint_max_bytes(sizeof(T) * 8) * 8;
+
+  template<typename T> static void write(BitStream &bs, const T &value)
+  {
+    static_assert(std::is_unsigned_v<T>, "VarUint needs an unsigned field");
+    bs.WriteVarUint(value);
+  }
+  // A value that does not fit the field is malformed rather than something to wrap around
+  template<typename Reader, typename T> static void read(Reader &bs, T &value)
+  {
+    const uint64_t decoded = bs.ReadVarUint();
+    if (decoded > uint64_t(std::numeric_limits<T>::max()))
+    {
+      bs.SetError();
+      value = 0;
+      return;
+    }
+    value = T(decoded);
+  }
+};
+
+struct VarInt  // zigzag LEB128
+{
+  static constexpr bool aligned = false;
+  template<typename T> static constexpr size_t max_bits = varint_max_bytes(sizeof(T) * 8) * 8;
+
+  template<typename T> static void write(BitStream &bs, const T &value)
+  {
+    static_assert(std::is_signed_v<T>, "VarInt needs a signed field");
+    bs.WriteVarInt(value);
+  }
+  template<typename Reader, typename T> static void read(Reader &bs, T &value)
+  {
+    const int64_t decoded = bs.ReadVarInt();
+    if (decoded < int64_t(std::numeric_limits<T>::min()) || decoded > int64_t(std::numeric_limits<T>::max()))
+    {
+      bs.SetError();
+      value = 0;
+      return;
+    }
+    value = T(decoded);
+  }
+};
+
+template<int64_t Min, int64_t Max>
+struct Bounded  // value - Min in just enough bits for [Min, Max]
+{
+  static_assert(Min <= Max, "empty range");
+  static constexpr bool aligned = false;
+  template<typename T> static constexpr size_t max_bits = std::bit_width(uint64_t(Max) - uint64_t(Min));
+
+  template<typename T> static void write(BitStream &bs, const T &value) { bs.WriteBounded(int64_t(value), Min, Max); }
+  template<typename Reader, typename T> static void read(Reader &bs, T &value) { value = T(bs.ReadBounded(Min, Max)); }
+};
+
+template<typename Q>
+struct Quantize  // float through a compile-time quantizer such as Quantized<Lo, Hi, Bits>
+{
+  static constexpr bool aligned = false;
+  template<typename T> static constexpr size_t max_bits = Q::num_bits;
+
+  static void write(BitStream &bs, float value) { bs.WriteQuantized<Q>(value); }
+  template<typename Reader> static void read(Reader &bs, float &value) { value = bs.template ReadQuantized<Q>(); }
+};
+
+struct Bit  // a bool in one bit
+{
+  static constexpr bool aligned = false;
+  template<typename T> static constexpr size_t max_bits = 1;
+
+  static void write(BitStream &bs, bool value) { bs.WriteBit(value); }
+  template<typename Reader> static void read(Reader &bs, bool &value) { value = bs.ReadBit(); }
+};
+
+template<typename M> struct member_traits;
+template<typename C, typename T> struct member_traits<T C::*> { using value_type = T; };
+
+template<auto Member, typename Encoding>
+struct Field
+{
+  using value_type = typename member_traits<decltype(Member)>::value_type;
+  static constexpr bool aligned = Encoding::aligned;
+  static constexpr size_t max_bits = Encoding::template max_bits<value_type>;
+
+  template<typename Message> static void write(BitStream &bs, const Message &msg) { Encoding::write(bs, msg.*Member); }
+  template<typename Reader, typename Message> static void read(Reader &bs, Message &msg) { Encoding::read(bs, msg.*Member); }
+};
+
+// For messages that are just their type byte
+struct NoFields {};
+
+template<typename Message, auto Type, typename... Fields>
+struct MessageSchema
+{
+  using message_type = Message;
+  static constexpr uint8_t type = uint8_t(Type);
+
+  // Byte-aligned fields may first pad to the next byte; aligning the worst-case position gives
+  // the worst case after the padding too
+  static constexpr size_t max_bits = []
+  {
+    size_t bits = 8;
+    ((bits = (Fields::aligned ? (bits + 7) & ~size_t(7) : bits) + Fields::max_bits), ...);
+    return bits;
+  }();
+  static constexpr size_t max_bytes = (max_bits + 7) / 8;
+
+  static void write(BitStream &bs, const Message &msg)
+  {
+    bs.Write<uint8_t>(type);
+    (Fields::write(bs, msg), ...);
+  }
+
+  // Skips the type byte, which the caller already dispatched on
+  template<typename Reader>
+  static void read(Reader &bs, Message &msg)
+  {
+    uint8_t msgType;
+    bs.template Read<uint8_t>(msgType);
+    (Fields::read(bs, msg), ...);
+  }
+};
+
+// Serializes straight into a packet created at the schema's max_bytes, then trims it to what was
+// written, which enet_packet_resize does in place
+template<typename Schema>
+ENetPacket *create_message_packet(const typename Schema::message_type &msg, enet_uint32 flags)
+{
+  ENetPacket *packet = enet_packet_create(nullptr, Schema::max_bytes, flags);
+  BitStream bs = BitStream::WrapStorage(packet->data, packet->dataLength);
+  Schema::write(bs, msg);
+  bs.FlushBits();
+  enet_packet_resize(packet, bs.GetSizeBytes());
+  return packet;
+}
+
+// Decodes without exceptions; false if the packet was truncated or malformed, in which case the
+// fields it did not cover read as zero and the message should be dropped
+template<typename Schema>
+bool read_message_packet(const ENetPacket *packet, typename Schema::message_type &msg)
+{
+  BitReader bs(packet->data, packet->dataLength);
+  Schema::read(bs, msg);
+  return !bs.HasError();
+}
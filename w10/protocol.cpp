@@ -1,50 +1,74 @@
 #include "protocol.h"
 #include "quantisation.h"
-#include <cstring> // memcpy
-#include <iostream>
+#include "message_schema.h"
 #include <stdlib.h>
+#include <algorithm>
+#include <cmath>
 
 static uint32_t xorCipherKey = 0;
 
+using PositionXQuantized = Quantized<-16.f, 16.f, 11>;
+using PositionYQuantized = Quantized<-8.f, 8.f, 10>;
+using OrientationQuantized = Quantized<-PI, PI, 8>;
+
+using JoinSchema = MessageSchema<NoFields, E_CLIENT_TO_SERVER_JOIN>;
+
+// Field by field: the struct's padding no longer goes on the wire
+using NewEntitySchema = MessageSchema<Entity, E_SERVER_TO_CLIENT_NEW_ENTITY,
+                                      Field<&Entity::color, Raw>,
+                                      Field<&Entity::x, Raw>,
+                                      Field<&Entity::y, Raw>,
+                                      Field<&Entity::speed, Raw>,
+                                      Field<&Entity::ori, Raw>,
+                                      Field<&Entity::thr, Raw>,
+                                      Field<&Entity::steer, Raw>,
+                                      Field<&Entity::eid, Raw>>;
+
+struct SetControlledEntity { uint16_t eid; };
+using SetControlledEntitySchema = MessageSchema<SetControlledEntity, E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY,
+                                                Field<&SetControlledEntity::eid, Raw>>;
+
+struct CipherKey { uint32_t key; };
+using CipherKeySchema = MessageSchema<CipherKey, E_SERVER_TO_CLIENT_KEY,
+                                      Field<&CipherKey::key, Raw>>;
+
+struct EntityInput { uint16_t eid; float thr, steer; };
+using EntityInputSchema = MessageSchema<EntityInput, E_CLIENT_TO_SERVER_INPUT,
+                                        Field<&EntityInput::eid, Raw>,
+                                        Field<&EntityInput::thr, Raw>,
+                                        Field<&EntityInput::steer, Raw>>;
+
+struct Snapshot { uint16_t eid; float x, y, ori; };
+using SnapshotSchema = MessageSchema<Snapshot, E_SERVER_TO_CLIENT_SNAPSHOT,
+                                     Field<&Snapshot::eid, Raw>,
+                                     Field<&Snapshot::x, Quantize<PositionXQuantized>>,
+                                     Field<&Snapshot::y, Quantize<PositionYQuantized>>,
+                                     Field<&Snapshot::ori, Quantize<OrientationQuantized>>>;
+
 void send_join(ENetPeer *peer)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t), ENET_PACKET_FLAG_RELIABLE);
-  *packet->data = E_CLIENT_TO_SERVER_JOIN;
+  enet_peer_send(peer, reliable_channel, create_message_packet<JoinSchema>({}, ENET_PACKET_FLAG_RELIABLE));
+}
 
-  enet_peer_send(peer, 0, packet);
+ENetPacket *create_new_entity_packet(const Entity &ent)
+{
+  return create_message_packet<NewEntitySchema>(ent, ENET_PACKET_FLAG_RELIABLE);
 }
 
 void send_new_entity(ENetPeer *peer, const Entity &ent)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(Entity),
-                                                   ENET_PACKET_FLAG_RELIABLE);
-  uint8_t *ptr = packet->data;
-  *ptr = E_SERVER_TO_CLIENT_NEW_ENTITY; ptr += sizeof(uint8_t);
-  memcpy(ptr, &ent, sizeof(Entity)); ptr += sizeof(Entity);
-
-  enet_peer_send(peer, 0, packet);
+  enet_peer_send(peer, reliable_channel, create_new_entity_packet(ent));
 }
 
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t),
-                                                   ENET_PACKET_FLAG_RELIABLE);
-  uint8_t *ptr = packet->data;
-  *ptr = E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY; ptr += sizeof(uint8_t);
-  memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-
-  enet_peer_send(peer, 0, packet);
+  enet_peer_send(peer, reliable_channel,
+                 create_message_packet<SetControlledEntitySchema>({eid}, ENET_PACKET_FLAG_RELIABLE));
 }
 
 void send_cipher_key(ENetPeer *peer, uint32_t key)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint32_t),
-                                                   ENET_PACKET_FLAG_RELIABLE);
-  uint8_t *ptr = packet->data;
-  *ptr = E_SERVER_TO_CLIENT_KEY; ptr += sizeof(uint8_t);
-  memcpy(ptr, &key, sizeof(uint32_t)); ptr += sizeof(uint32_t);
-
-  enet_peer_send(peer, 0, packet);
+  enet_peer_send(peer, reliable_channel, create_message_packet<CipherKeySchema>({key}, ENET_PACKET_FLAG_RELIABLE));
 }
 
 void fuzz_packet_data(ENetPacket *packet)
@@ -54,68 +78,48 @@ void fuzz_packet_data(ENetPacket *packet)
 
 void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float ori)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   sizeof(float) * 2,
-                                                   //sizeof(uint8_t),
-                                                   ENET_PACKET_FLAG_UNSEQUENCED);
-  uint8_t *ptr = packet->data;
-  *ptr = E_CLIENT_TO_SERVER_INPUT; ptr += sizeof(uint8_t);
-  memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  memcpy(ptr, &thr, sizeof(float)); ptr += sizeof(float);
-  memcpy(ptr, &ori, sizeof(float)); ptr += sizeof(float);
-  /*
-  float4bitsQuantized thrPacked(thr, -1.f, 1.f);
-  float4bitsQuantized oriPacked(ori, -1.f, 1.f);
-  uint8_t thrSteerPacked = (thrPacked.packedVal << 4) | oriPacked.packedVal;
-  memcpy(ptr, &thrSteerPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  */
-  /*
-  memcpy(ptr, &thrPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  memcpy(ptr, &oriPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-  */
+  ENetPacket *packet = create_message_packet<EntityInputSchema>({eid, thr, ori}, ENET_PACKET_FLAG_UNSEQUENCED);
 
   fuzz_packet_data(packet);
   cipher_data(packet);
 
-  enet_peer_send(peer, 1, packet);
+  enet_peer_send(peer, unreliable_channel, packet);
+}
+
+ENetPacket *create_snapshot_packet(uint16_t eid, float x, float y, float ori)
+{
+  return create_message_packet<SnapshotSchema>({eid, x, y, ori}, ENET_PACKET_FLAG_UNSEQUENCED);
 }
 
 void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   sizeof(uint16_t) +
-                                                   sizeof(uint16_t) +
-                                                   sizeof(uint8_t),
-                                                   ENET_PACKET_FLAG_UNSEQUENCED);
-  uint8_t *ptr = packet->data;
-  *ptr = E_SERVER_TO_CLIENT_SNAPSHOT; ptr += sizeof(uint8_t);
-  memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  uint16_t xPacked = pack_float<uint16_t>(x, -16.f, 16.f, 11);
-  uint16_t yPacked = pack_float<uint16_t>(y, -8.f, 8.f, 10);
-  uint8_t oriPacked = pack_float<uint8_t>(ori, -PI, PI, 8);
-  //printf("xPacked/unpacked %d %f\n", xPacked, x);
-  memcpy(ptr, &xPacked, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  memcpy(ptr, &yPacked, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  memcpy(ptr, &oriPacked, sizeof(uint8_t)); ptr += sizeof(uint8_t);
-
-  enet_peer_send(peer, 1, packet);
+  enet_peer_send(peer, unreliable_channel, create_snapshot_packet(eid, x, y, ori));
 }
 
 MessageType get_packet_type(ENetPacket *packet)
 {
+  if (packet->dataLength == 0)
+    return E_INVALID_PACKET;
   return (MessageType)*packet->data;
 }
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent)
+bool deserialize_new_entity(ENetPacket *packet, Entity &ent)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  ent = *(Entity*)(ptr); ptr += sizeof(Entity);
+  // Fields the schema does not carry keep the caller's values
+  Entity msg = ent;
+  if (!read_message_packet<NewEntitySchema>(packet, msg))
+    return false;
+  ent = msg;
+  return true;
 }
 
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
+bool deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+  SetControlledEntity msg;
+  if (!read_message_packet<SetControlledEntitySchema>(packet, msg))
+    return false;
+  eid = msg.eid;
+  return true;
 }
 
 void xor_packet_data(ENetPacket *packet, uint8_t *key_ptr)
@@ -139,42 +143,39 @@ void decipher_data(ENetPacket *packet, ENetPeer *peer)
   xor_packet_data(packet, (uint8_t*)peer->data);
 }
 
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer)
+bool deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
+  EntityInput msg;
+  if (!read_message_packet<EntityInputSchema>(packet, msg))
+    return false;
+  // Inputs are fuzzed in flight, which keeps the length: check the values themselves. A flipped
+  // eid byte still goes unnoticed.
+  if (!std::isfinite(msg.thr) || !std::isfinite(msg.steer))
+    return false;
+  eid = msg.eid;
+  thr = std::clamp(msg.thr, -1.f, 1.f);
+  steer = std::clamp(msg.steer, -1.f, 1.f);
+  return true;
+}
 
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  thr = *(float*)(ptr); ptr += sizeof(float);
-  steer = *(float*)(ptr); ptr += sizeof(float);
-  //uint8_t thrSteerPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  /*
-  uint8_t thrPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  uint8_t oriPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  */
-  /*
-  static uint8_t neutralPackedValue = pack_float<uint8_t>(0.f, -1.f, 1.f, 4);
-  float4bitsQuantized thrPacked(thrSteerPacked >> 4);
-  float4bitsQuantized steerPacked(thrSteerPacked & 0x0f);
-  thr = thrPacked.packedVal == neutralPackedValue ? 0.f : thrPacked.unpack(-1.f, 1.f);
-  steer = steerPacked.packedVal == neutralPackedValue ? 0.f : steerPacked.unpack(-1.f, 1.f);
-  */
-}
-
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori)
+bool deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint16_t xPacked = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint16_t yPacked = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  uint8_t oriPacked = *(uint8_t*)(ptr); ptr += sizeof(uint8_t);
-  x = unpack_float<uint16_t>(xPacked, -16.f, 16.f, 11);
-  y = unpack_float<uint16_t>(yPacked, -8.f, 8.f, 10);
-  ori = unpack_float<uint8_t>(oriPacked, -PI, PI, 8);
+  Snapshot msg;
+  if (!read_message_packet<SnapshotSchema>(packet, msg))
+    return false;
+  eid = msg.eid;
+  x = msg.x;
+  y = msg.y;
+  ori = msg.ori;
+  return true;
 }
 
-void deserialize_and_set_key(ENetPacket *packet)
+bool deserialize_and_set_key(ENetPacket *packet)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  xorCipherKey = *(uint32_t*)(ptr); ptr += sizeof(uint32_t);
+  CipherKey msg;
+  if (!read_message_packet<CipherKeySchema>(packet, msg))
+    return false;
+  xorCipherKey = msg.key;
+  return true;
 }
 
@@ -1,12 +1,14 @@
 #pragma once
 #include "mathUtils.h"
+#include <cstdint>
 #include <limits>
 
+// Rounds to the nearest of the 2^num_bits codes, so unpacking is off by at most half a step
 template<typename T>
 T pack_float(float v, float lo, float hi, int num_bits)
 {
   T range = (1 << num_bits) - 1;//std::numeric_limits<T>::max();
-  return range * ((clamp(v, lo, hi) - lo) / (hi - lo));
+  return T(range * ((clamp(v, lo, hi) - lo) / (hi - lo)) + 0.5f);
 }
 
 template<typename T>
@@ -30,3 +32,28 @@ struct PackedFloat
 
 typedef PackedFloat<uint8_t, 4> float4bitsQuantized;
 
+// Quantizer with its range and width fixed at compile time, for BitStream::WriteQuantized.
+// [Lo, Hi] maps onto codes 0 .. 2^NumBits - 1 with both ends exact; packing rounds to the
+// nearest code, so the error is at most step / 2. Values outside the range (and NaN, which goes
+// to Lo) are clamped.
+template<float Lo, float Hi, int NumBits>
+struct Quantized
+{
+  static_assert(Lo < Hi, "empty range");
+  static_assert(NumBits > 0 && NumBits <= 32, "codes must fit 32 bits");
+
+  static constexpr int num_bits = NumBits;
+  static constexpr uint32_t max_code = uint32_t((uint64_t(1) << NumBits) - 1);
+  static constexpr float step = (Hi - Lo) / max_code;
+
+  static constexpr uint32_t pack(float v)
+  {
+    v = v > Lo ? (v < Hi ? v : Hi) : Lo;
+    return uint32_t(double(v - Lo) / double(Hi - Lo) * max_code + 0.5);
+  }
+
+  static constexpr float unpack(uint32_t code)
+  {
+    return float(Lo + double(code) * (double(Hi - Lo) / max_code));
+  }
+};
@@ -3,12 +3,13 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <sstream>
+#include "protocol.h"
+#include "player_table.h"
 
 struct Player {
-  int id;
+  uint16_t id;
   float x, y;
-  int ping;
+  uint32_t ping;
 };
 
 void send_fragmented_packet(ENetPeer *peer) {
@@ -32,13 +33,6 @@ void send_micro_packet(ENetPeer *peer) {
   enet_peer_send(peer, 1, packet);
 }
 
-void send_position(ENetPeer *peer, float x, float y) {
-  char posMsg[64];
-  snprintf(posMsg, sizeof(posMsg), "POS %.2f %.2f", x, y);
-  ENetPacket *packet = enet_packet_create(posMsg, strlen(posMsg) + 1, ENET_PACKET_FLAG_UNSEQUENCED);
-  enet_peer_send(peer, 0, packet);
-}
-
 int main(int argc, const char **argv) {
   int width = 800, height = 600;
   InitWindow(width, height, "w2 MIPT networked");
@@ -83,7 +77,7 @@ int main(int argc, const char **argv) {
   ENetPeer *gamePeer = nullptr;
 
   std::string gameServerStatus = "Connecting to lobby...";
-  std::vector<Player> players;
+  PlayerTable<Player> players;
 
   float posx = GetRandomValue(100, 500);
   float posy = GetRandomValue(100, 500);
@@ -125,72 +119,45 @@ int main(int argc, const char **argv) {
             }
           }
           else if (event.peer == gamePeer) {
-            if (strncmp(data, "WELCOME", 7) == 0) {
-              sscanf(data, "WELCOME %d", &myPlayerId);
-              gameServerStatus = "Playing as player " + std::to_string(myPlayerId);
-            } 
-            else if (strncmp(data, "PLAYERS", 7) == 0) {
-              players.clear();
-              std::istringstream ss(std::string(data + 8));
-              Player player;
-              std::string token;
-              while (std::getline(ss, token, ';')) {
-                std::istringstream playerStream(token);
-                if (playerStream >> player.id >> player.x >> player.y >> player.ping)
-                  players.push_back(player);
-              }
-            }
-            else if (strncmp(data, "POS", 3) == 0) {
-              int playerId;
-              float x, y;
-              if (sscanf(data, "POS %d %f %f", &playerId, &x, &y) == 3) {
-                for (auto& player : players) {
-                  if (player.id == playerId) {
-                    player.x = x;
-                    player.y = y;
-                    break;
-                  }
-                }
+            uint16_t playerId;
+            switch (get_packet_type(event.packet)) {
+            case E_SERVER_TO_CLIENT_WELCOME:
+              if (deserialize_player_id(event.packet, playerId)) {
+                myPlayerId = playerId;
+                gameServerStatus = "Playing as player " + std::to_string(myPlayerId);
               }
-            }
-            else if (strncmp(data, "NEWPLAYER", 9) == 0) {
-              int playerId;
-              if (sscanf(data, "NEWPLAYER %d", &playerId) == 1) {
-                bool exists = false;
-                for (const auto& p : players)
-                  if (p.id == playerId)
-                    exists = true;
-                if (!exists)
-                  players.push_back(Player{playerId, 0.f, 0.f, 0});
-              }
-            }
-            else if (strncmp(data, "PLAYERLEFT", 10) == 0) {
-              int playerId;
-              if (sscanf(data, "PLAYERLEFT %d", &playerId) == 1) {
-                players.erase(std::remove_if(players.begin(), players.end(),
-                  [=](const Player& p) { return p.id == playerId; }), players.end());
-              }
-            }
-            else if (strncmp(data, "PINGS", 5) == 0) {
-              std::istringstream ss(std::string(data + 6));
-              std::string token;
-              while (std::getline(ss, token, ';')) {
-                if (token.empty()) continue;
-                int playerId, ping;
-                std::istringstream ts(token);
-                if (ts >> playerId >> ping) {
-                  bool found = false;
-                  for (auto& p : players) {
-                    if (p.id == playerId) {
-                      p.ping = ping;
-                      found = true;
-                      break;
-                    }
-                  }
-                  if (!found && playerId != myPlayerId)
-                    players.push_back(Player{playerId, 0.f, 0.f, ping});
+              break;
+            case E_SERVER_TO_CLIENT_PLAYERS:
+              players.clear();
+              deserialize_player_list(event.packet, [&](uint16_t id, float px, float py, uint16_t ping) {
+                players.insert(id) = Player{id, px, py, ping};
+              });
+              break;
+            case E_SERVER_TO_CLIENT_SNAPSHOT:
+              deserialize_snapshot(event.packet, [&](uint16_t id, float px, float py) {
+                if (Player *player = players.find(id)) {
+                  player->x = px;
+                  player->y = py;
                 }
-              }
+              });
+              break;
+            case E_SERVER_TO_CLIENT_NEW_PLAYER:
+              if (deserialize_player_id(event.packet, playerId))
+                players.insert(playerId);
+              break;
+            case E_SERVER_TO_CLIENT_PLAYER_LEFT:
+              if (deserialize_player_id(event.packet, playerId))
+                players.erase(playerId);
+              break;
+            case E_SERVER_TO_CLIENT_PINGS:
+              deserialize_pings(event.packet, [&](uint16_t id, uint16_t ping) {
+                if (Player *player = players.find(id))
+                  player->ping = ping;
+                else if (id != myPlayerId)
+                  players.insert(id).ping = ping;
+              });
+              break;
+            default: break;
             }
           }
 
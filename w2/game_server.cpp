@@ -3,73 +3,203 @@
 #include <iostream>
 #include <vector>
 #include <string>
-#include <unordered_map>
-#include <sstream>
-#include <algorithm>
-#include <random>
 #include <chrono>
+#include <cstring>
+#include "protocol.h"
+#include "player_table.h"
+#include "interest_grid.h"
+#include "tick_scheduler.h"
+#include "enet_broadcast.h"
 
 struct Player {
-  int id;
+  uint16_t id;
   float x, y;
-  int ping;
+  uint32_t ping;
   ENetPeer* peer;
   std::string name;
 };
 
-int generatePlayerID() {
-  static int nextID = 1;
-  return nextID++;
-}
+using Players = PlayerTable<Player>;
 
-void sendPlayerList(const std::vector<Player>& players, ENetPeer* targetPeer) {
-  std::stringstream ss;
-  ss << "PLAYERS ";
-  for (const auto& player : players)
-    ss << player.id << " " << player.x << " " << player.y << " " << player.ping << ";";
+constexpr size_t max_players = 32;
+constexpr uint32_t heartbeat_interval_ms = 1000;
+constexpr uint32_t lobby_retry_ms = 2000;
 
-  std::string str = ss.str();
-  ENetPacket* packet = enet_packet_create(str.c_str(), str.size() + 1, ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(targetPeer, 0, packet);
+// Simulation and snapshots run at 20 Hz; pings and tick stats go out every few ticks
+constexpr uint32_t tick_period_ms = 50;
+constexpr uint64_t ping_every_ticks = 10;
+constexpr uint64_t stats_every_ticks = 100;
+
+// Connection to the lobby's server pool: REGISTER once connected, then a HEARTBEAT with the
+// player count and the share of wall time spent working (tick load, permille) every second.
+// A lost lobby is retried so that restarting it does not orphan running servers.
+struct LobbyLink {
+  ENetHost* host = nullptr;
+  ENetPeer* peer = nullptr;
+  ENetAddress address;
+  std::string publicHost;
+  int port = 0;
+  bool connected = false;
+  uint32_t lastAttempt = 0;
+  uint32_t lastHeartbeat = 0;
+};
+
+void sendLobbyText(ENetPeer* peer, const std::string& msg) {
+  enet_peer_send(peer, 0, enet_packet_create(msg.c_str(), msg.length() + 1, ENET_PACKET_FLAG_RELIABLE));
 }
 
-void broadcastNewPlayer(const Player& newPlayer, const std::vector<Player>& players) {
-  std::stringstream ss;
-  ss << "NEWPLAYER " << newPlayer.id << " " << newPlayer.name;
-  std::string str = ss.str();
+// Returns true when a heartbeat went out, so the caller can start a new load window
+bool serviceLobby(LobbyLink& lobby, size_t playerCount, float tickLoad) {
+  ENetEvent event;
+  while (enet_host_service(lobby.host, &event, 0) > 0) {
+    switch (event.type) {
+      case ENET_EVENT_TYPE_CONNECT:
+        lobby.connected = true;
+        sendLobbyText(lobby.peer, "REGISTER " + lobby.publicHost + " " + std::to_string(lobby.port) + " " +
+                                  std::to_string(max_players));
+        std::cout << "Registered with the lobby\n";
+        break;
+      case ENET_EVENT_TYPE_DISCONNECT:
+        std::cout << "Lost the lobby, retrying\n";
+        lobby.connected = false;
+        lobby.peer = nullptr;
+        break;
+      case ENET_EVENT_TYPE_RECEIVE:
+        enet_packet_destroy(event.packet);
+        break;
+      default: break;
+    }
+  }
 
-  for (const auto& player : players) {
-    if (player.id == newPlayer.id) continue;
-    ENetPacket* packet = enet_packet_create(str.c_str(), str.length() + 1, ENET_PACKET_FLAG_RELIABLE);
-    enet_peer_send(player.peer, 0, packet);
+  uint32_t now = enet_time_get();
+  if (!lobby.peer && now - lobby.lastAttempt > lobby_retry_ms) {
+    lobby.lastAttempt = now;
+    lobby.peer = enet_host_connect(lobby.host, &lobby.address, 2, game_server_connect_data);
   }
+  if (!lobby.connected || now - lobby.lastHeartbeat < heartbeat_interval_ms)
+    return false;
+  lobby.lastHeartbeat = now;
+  sendLobbyText(lobby.peer, "HEARTBEAT " + std::to_string(playerCount) + " " + std::to_string(int(tickLoad * 1000.f)));
+  return true;
 }
 
-void broadcastPositions(const std::vector<Player>& players) {
-  for (const auto& sender : players) {
-    std::stringstream ss;
-    ss << "POS " << sender.id << " " << sender.x << " " << sender.y;
-    std::string str = ss.str();
+// Ids of players that left are handed out again, so they stay dense slot indices
+uint16_t generatePlayerID(std::vector<uint16_t>& freeIDs) {
+  static uint16_t nextID = 1;
+  if (!freeIDs.empty()) {
+    uint16_t id = freeIDs.back();
+    freeIDs.pop_back();
+    return id;
+  }
+  return nextID++;
+}
 
-    for (const auto& receiver : players) {
-      if (receiver.id == sender.id) continue;
-      ENetPacket* packet = enet_packet_create(str.c_str(), str.length() + 1, ENET_PACKET_FLAG_UNSEQUENCED);
-      enet_peer_send(receiver.peer, 0, packet);
-    }
+// Only peers that got a welcome are players, so fan-out goes over the table rather than the host
+struct PlayerPeers {
+  const Players& players;
+
+  struct iterator {
+    Players::const_iterator it;
+    ENetPeer* operator*() const { return it->peer; }
+    iterator& operator++() { ++it; return *this; }
+    bool operator!=(const iterator& other) const { return it != other.it; }
+  };
+
+  iterator begin() const { return {players.begin()}; }
+  iterator end() const { return {players.end()}; }
+};
+
+void broadcastNewPlayer(const Player& newPlayer, const Players& players) {
+  multicast_packet(PlayerPeers{players}, 0, create_new_player_packet(newPlayer.id), {newPlayer.peer});
+}
+
+// Interest management. Players within the interest radius of a receiver are sent every
+// broadcast; the others only every farInterval broadcasts, each broadcast carrying the slice of
+// them whose id matches its phase. The grid has cells one radius wide and everyone in a cell
+// shares one snapshot: the 3x3 block of cells around it plus the far slice. A snapshot holds at
+// most max_snapshot_entries players, so per-client bandwidth stays bounded as the session grows;
+// when near or far players overflow it, consecutive broadcasts take consecutive windows of them.
+struct InterestConfig {
+  float radius = 200.f;
+  uint32_t farInterval = 4;
+};
+
+constexpr size_t max_snapshot_entries = 64;
+
+struct SnapshotEntry {
+  uint16_t id;
+  float x, y;
+};
+
+struct PositionBroadcast {
+  InterestGrid grid;
+  std::vector<uint32_t> near, farSlice, far;
+  std::vector<SnapshotEntry> entries;
+  std::vector<ENetPeer*> receivers;
+  uint32_t tick = 0;
+};
+
+// Up to `budget` items of list, starting `offset` in and wrapping around
+static void appendWindow(const Players& players, const std::vector<uint32_t>& list, size_t budget, size_t offset,
+                         std::vector<SnapshotEntry>& entries) {
+  size_t n = std::min(budget, list.size());
+  for (size_t i = 0; i < n; ++i) {
+    const Player& player = players.begin()[list[(offset + i) % list.size()]];
+    entries.push_back({player.id, player.x, player.y});
   }
 }
 
-void broadcastPings(const std::vector<Player>& players) {
+void broadcastPositions(const Players& players, const InterestConfig& config, PositionBroadcast& bc) {
+  uint32_t tick = bc.tick++;
+  bc.grid.clear(config.radius);
+  bc.farSlice.clear();
+  uint32_t idx = 0;
   for (const auto& player : players) {
-    std::stringstream ss;
-    ss << "PINGS ";
-    for (const auto& p : players)
-      ss << p.id << " " << p.ping << ";";
-
-    std::string str = ss.str();
-    ENetPacket* packet = enet_packet_create(str.c_str(), str.length() + 1, 0);
-    enet_peer_send(player.peer, 0, packet);
+    bc.grid.insert(idx, player.x, player.y);
+    if ((player.id + tick) % config.farInterval == 0)
+      bc.farSlice.push_back(idx);
+    ++idx;
   }
+  bc.grid.compact();
+
+  bc.grid.forEachCell([&](const InterestGrid::Cell& cell) {
+    bc.near.clear();
+    bc.grid.forEachNear(cell, [&](uint32_t i) { bc.near.push_back(i); });
+    bc.far.clear();
+    for (uint32_t i : bc.farSlice) {
+      const Player& player = players.begin()[i];
+      if (!bc.grid.isNear(cell, player.x, player.y))
+        bc.far.push_back(i);
+    }
+
+    bc.entries.clear();
+    appendWindow(players, bc.near, max_snapshot_entries, size_t(tick) * max_snapshot_entries, bc.entries);
+    size_t budget = max_snapshot_entries - bc.entries.size();
+    appendWindow(players, bc.far, budget, size_t(tick / config.farInterval) * budget, bc.entries);
+
+    bc.receivers.clear();
+    for (uint32_t i : cell.members)
+      bc.receivers.push_back(players.begin()[i].peer);
+    multicast_packet(bc.receivers, 0, create_snapshot_packet(bc.entries));
+  });
+}
+
+void broadcastPings(const Players& players) {
+  multicast_packet(PlayerPeers{players}, 0, create_pings_packet(players));
+}
+
+// Covers the last stats_every_ticks ticks
+void printStats(const TickScheduler::Stats& stats, TickScheduler::Clock::time_point now) {
+  using ms = std::chrono::duration<double, std::milli>;
+  if (stats.ticks == 0)
+    return;
+  printf("Ticks: %llu, duration avg %.3f max %.3f ms, late avg %.3f max %.3f ms, "
+         "overruns %llu, caught up %llu, skipped %llu, load %.1f%%\n",
+         (unsigned long long)stats.ticks,
+         ms(stats.totalDuration).count() / stats.ticks, ms(stats.maxDuration).count(),
+         ms(stats.totalLateness).count() / stats.ticks, ms(stats.maxLateness).count(),
+         (unsigned long long)stats.overruns, (unsigned long long)stats.caughtUp,
+         (unsigned long long)stats.skipped, stats.load(now) * 100.f);
 }
 
 int main(int argc, const char **argv) {
@@ -78,118 +208,136 @@ int main(int argc, const char **argv) {
     return 1;
   }
 
-  int port = (argc > 1) ? std::atoi(argv[1]) : 10888;
+  // game_server [-r interest radius] [-f far update interval] [port] [lobby host] [host name clients should use]
+  InterestConfig interest;
+  std::vector<const char*> positional;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+      interest.radius = std::max(1.f, float(std::atof(argv[++i])));
+    else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+      interest.farInterval = uint32_t(std::max(1, std::atoi(argv[++i])));
+    else
+      positional.push_back(argv[i]);
+  }
+  int port = (positional.size() > 0) ? std::atoi(positional[0]) : 10888;
+  const char* lobbyHost = (positional.size() > 1) ? positional[1] : "localhost";
 
   ENetAddress address;
   address.host = ENET_HOST_ANY;
   address.port = port;
 
-  ENetHost *server = enet_host_create(&address, 32, 2, 0, 0);
+  ENetHost *server = enet_host_create(&address, max_players, 2, 0, 0);
   if (!server) {
     std::cerr << "Cannot create ENet game server\n";
     return 1;
   }
 
-  std::cout << "Game server started on port " << port << "\n";
-
-  std::vector<Player> players;
-  uint32_t lastBroadcastTime = enet_time_get();
-  uint32_t lastPingTime = enet_time_get();
-
-  while (true) {
-    ENetEvent event;
-    while (enet_host_service(server, &event, 10) > 0) {
-      switch (event.type) {
-        case ENET_EVENT_TYPE_CONNECT: {
-          std::cout << "Player connected from " << event.peer->address.host
-                    << ":" << event.peer->address.port << "\n";
-
-          Player newPlayer;
-          newPlayer.id = generatePlayerID();
-          newPlayer.name = "Player_" + std::to_string(newPlayer.id);
-          newPlayer.x = GetRandomValue(100, 500);
-          newPlayer.y = GetRandomValue(100, 300);
-          newPlayer.ping = event.peer->roundTripTime;
-          newPlayer.peer = event.peer;
-
-          event.peer->data = new int(newPlayer.id);
-
-          std::string welcome = "WELCOME " + std::to_string(newPlayer.id) + " " + newPlayer.name;
-          ENetPacket* welcomePacket = enet_packet_create(welcome.c_str(), welcome.length() + 1, ENET_PACKET_FLAG_RELIABLE);
-          enet_peer_send(event.peer, 0, welcomePacket);
-
-          sendPlayerList(players, event.peer);
-          players.push_back(newPlayer);
-          broadcastNewPlayer(newPlayer, players);
-          break;
-        }
+  LobbyLink lobby;
+  lobby.host = enet_host_create(nullptr, 1, 2, 0, 0);
+  enet_address_set_host(&lobby.address, lobbyHost);
+  lobby.address.port = lobby_port;
+  lobby.publicHost = (positional.size() > 2) ? positional[2] : "localhost";
+  lobby.port = port;
+  lobby.lastAttempt = enet_time_get() - lobby_retry_ms - 1;
+  if (!lobby.host) {
+    std::cerr << "Cannot create ENet lobby client\n";
+    return 1;
+  }
+
+  std::cout << "Game server started on port " << port << ", interest radius " << interest.radius
+            << ", far players every " << interest.farInterval << " broadcasts\n";
+
+  Players players;
+  std::vector<uint16_t> freeIDs;
+  PositionBroadcast positionBroadcast;
+  TickScheduler scheduler{std::chrono::milliseconds{tick_period_ms}};
+  // The heartbeat's tick load covers the time since the previous heartbeat
+  TickScheduler::Clock::duration heartbeatBusy{};
+  TickScheduler::Clock::time_point heartbeatStart = TickScheduler::Clock::now();
+
+  auto onEvent = [&](ENetEvent& event) {
+    switch (event.type) {
+      case ENET_EVENT_TYPE_CONNECT: {
+        std::cout << "Player connected from " << event.peer->address.host
+                  << ":" << event.peer->address.port << "\n";
+
+        Player newPlayer;
+        newPlayer.id = generatePlayerID(freeIDs);
+        newPlayer.name = "Player_" + std::to_string(newPlayer.id);
+        newPlayer.x = GetRandomValue(100, 500);
+        newPlayer.y = GetRandomValue(100, 300);
+        newPlayer.ping = event.peer->roundTripTime;
+        newPlayer.peer = event.peer;
+
+        event.peer->data = new int(newPlayer.id);
+
+        send_welcome(event.peer, newPlayer.id);
+        send_player_list(event.peer, players);
+        players.insert(newPlayer.id) = newPlayer;
+        broadcastNewPlayer(newPlayer, players);
+        break;
+      }
 
-        case ENET_EVENT_TYPE_RECEIVE: {
-          int* playerID = static_cast<int*>(event.peer->data);
-          if (playerID) {
-            auto it = std::find_if(players.begin(), players.end(), 
-              [=](const Player& p) { return p.id == *playerID; });
-
-            if (it != players.end()) {
-              it->ping = event.peer->roundTripTime;
-
-              std::string msg((const char*)event.packet->data);
-              if (msg.rfind("POS ", 0) == 0) {
-                std::istringstream ss(msg.substr(4));
-                float x, y;
-                if (ss >> x >> y) {
-                  it->x = x;
-                  it->y = y;
-                }
-              }
+      case ENET_EVENT_TYPE_RECEIVE: {
+        int* playerID = static_cast<int*>(event.peer->data);
+        if (playerID) {
+          if (Player* player = players.find(*playerID)) {
+            player->ping = event.peer->roundTripTime;
+
+            float x, y;
+            if (get_packet_type(event.packet) == E_CLIENT_TO_SERVER_POSITION &&
+                deserialize_position(event.packet, x, y)) {
+              player->x = x;
+              player->y = y;
             }
           }
-
-          enet_packet_destroy(event.packet);
-          break;
         }
 
-        case ENET_EVENT_TYPE_DISCONNECT: {
-          std::cout << "Player disconnected from " << event.peer->address.host
-                    << ":" << event.peer->address.port << "\n";
-
-          int* playerID = static_cast<int*>(event.peer->data);
-          if (playerID) {
-            auto it = std::find_if(players.begin(), players.end(),
-              [=](const Player& p) { return p.id == *playerID; });
-
-            if (it != players.end()) {
-              int id = *playerID;
-              players.erase(it);
+        enet_packet_destroy(event.packet);
+        break;
+      }
 
-              std::string leftMsg = "PLAYERLEFT " + std::to_string(id);
-              for (const auto& p : players) {
-                ENetPacket* packet = enet_packet_create(leftMsg.c_str(), leftMsg.length() + 1, ENET_PACKET_FLAG_RELIABLE);
-                enet_peer_send(p.peer, 0, packet);
-              }
-            }
+      case ENET_EVENT_TYPE_DISCONNECT: {
+        std::cout << "Player disconnected from " << event.peer->address.host
+                  << ":" << event.peer->address.port << "\n";
 
-            delete playerID;
-            event.peer->data = nullptr;
+        int* playerID = static_cast<int*>(event.peer->data);
+        if (playerID) {
+          uint16_t id = uint16_t(*playerID);
+          if (players.erase(id)) {
+            freeIDs.push_back(id);
+            multicast_packet(PlayerPeers{players}, 0, create_player_left_packet(id));
           }
-          break;
-        }
 
-        default: break;
+          delete playerID;
+          event.peer->data = nullptr;
+        }
+        break;
       }
-    }
 
-    uint32_t now = enet_time_get();
-    if (now - lastBroadcastTime > 50) {
-      lastBroadcastTime = now;
-      if (!players.empty()) broadcastPositions(players);
+      default: break;
     }
-
-    if (now - lastPingTime > 500) {
-      lastPingTime = now;
-      if (!players.empty()) broadcastPings(players);
+  };
+
+  auto onTick = [&](uint64_t tick) {
+    if (!players.empty()) broadcastPositions(players, interest, positionBroadcast);
+    if (tick % ping_every_ticks == 0 && !players.empty()) broadcastPings(players);
+
+    TickScheduler::Clock::time_point now = TickScheduler::Clock::now();
+    float heartbeatLoad = std::chrono::duration<float>(scheduler.totalBusy() - heartbeatBusy) /
+                          std::chrono::duration<float>(now - heartbeatStart);
+    if (serviceLobby(lobby, players.size(), heartbeatLoad)) {
+      heartbeatBusy = scheduler.totalBusy();
+      heartbeatStart = now;
     }
-  }
+    if (tick % stats_every_ticks == 0) {
+      printStats(scheduler.getStats(), now);
+      scheduler.resetStats();
+    }
+  };
+
+  while (true)
+    scheduler.runOnce(server, onEvent, onTick);
 
   for (auto& p : players) {
     if (p.peer->data) {
@@ -198,6 +346,7 @@ int main(int argc, const char **argv) {
     }
   }
 
+  enet_host_destroy(lobby.host);
   enet_host_destroy(server);
   enet_deinitialize();
   return 0;
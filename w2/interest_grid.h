@@ -0,0 +1,81 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Uniform grid over an unbounded plane, rebuilt every broadcast. Cells are cellSize wide, so
+// everything within cellSize of a point lies in the 3x3 block of cells around it. Members are
+// indices into the caller's dense player array. Cell vectors are kept across rebuilds to reuse
+// their storage; cells nobody visits any more are dropped once they outnumber the members.
+class InterestGrid {
+public:
+  struct Cell {
+    int32_t x, y;
+    std::vector<uint32_t> members;
+  };
+
+  void clear(float size) {
+    cellSize = size;
+    count = 0;
+    for (auto& it : cells)
+      it.second.members.clear();
+  }
+
+  void insert(uint32_t idx, float x, float y) {
+    int32_t cx = coord(x), cy = coord(y);
+    Cell& cell = cells[key(cx, cy)];
+    cell.x = cx;
+    cell.y = cy;
+    cell.members.push_back(idx);
+    ++count;
+  }
+
+  // Call after the inserts of one rebuild
+  void compact() {
+    if (cells.size() <= 4 * count + 16)
+      return;
+    for (auto it = cells.begin(); it != cells.end();)
+      it = it->second.members.empty() ? cells.erase(it) : std::next(it);
+  }
+
+  // fn(const Cell&) for every occupied cell
+  template<typename F>
+  void forEachCell(F&& fn) const {
+    for (const auto& it : cells)
+      if (!it.second.members.empty())
+        fn(it.second);
+  }
+
+  // fn(idx) for every member of the 3x3 block around the cell, its own members first
+  template<typename F>
+  void forEachNear(const Cell& cell, F&& fn) const {
+    for (uint32_t idx : cell.members)
+      fn(idx);
+    for (int32_t dy = -1; dy <= 1; ++dy)
+      for (int32_t dx = -1; dx <= 1; ++dx) {
+        if (dx == 0 && dy == 0)
+          continue;
+        auto it = cells.find(key(cell.x + dx, cell.y + dy));
+        if (it != cells.end())
+          for (uint32_t idx : it->second.members)
+            fn(idx);
+      }
+  }
+
+  bool isNear(const Cell& cell, float x, float y) const {
+    int32_t cx = coord(x), cy = coord(y);
+    return std::abs(cx - cell.x) <= 1 && std::abs(cy - cell.y) <= 1;
+  }
+
+private:
+  int32_t coord(float v) const { return int32_t(std::floor(v / cellSize)); }
+
+  static uint64_t key(int32_t x, int32_t y) {
+    return (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
+  }
+
+  std::unordered_map<uint64_t, Cell> cells;
+  float cellSize = 1.f;
+  size_t count = 0;
+};
@@ -1,104 +1,263 @@
 #include <enet/enet.h>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <string>
 #include <cstring>
 #include <cstdio>
+#include "enet_broadcast.h"
+#include "protocol.h"
+#include "match_queue.h"
 
-struct GameServerInfo 
+// Game servers connect with game_server_connect_data and announce themselves with
+//   REGISTER <host> <port> <capacity>
+// then keep sending
+//   HEARTBEAT <players> <tick load, permille>
+// A server that misses heartbeats for heartbeat_timeout_ms or disconnects leaves the pool.
+struct GameServerInfo
 {
-  int port;
+  ENetPeer *peer;         // nullptr for the static server given on the command line
   std::string host;
-  bool sessionStarted;
+  int port;
+  int capacity;
+  int players;            // as of the last heartbeat
+  int pending;            // sent there since and not reported yet; for the static server, everyone
+                          // ever sent there, since it never reports players leaving
+  float tickLoad;         // share of the server frame spent working, 0..1
+  uint32_t lastHeartbeat;
+  uint32_t lastAssigned;
+};
+
+constexpr uint32_t heartbeat_timeout_ms = 3000;
+constexpr size_t lobby_max_peers = ENET_PROTOCOL_MAXIMUM_PEER_ID;
+constexpr size_t rtt_refresh_per_loop = 64;
+// Clients sent to a server get this long to connect and show up in its heartbeat
+constexpr uint32_t pending_grace_ms = 2000;
+
+// Seats and CPU both run out; whichever is closer to the limit decides
+static float load(const GameServerInfo &server)
+{
+  float occupancy = float(server.players + server.pending) / float(std::max(server.capacity, 1));
+  return std::max(occupancy, server.tickLoad);
+}
+
+static GameServerInfo *find_server(std::vector<GameServerInfo> &servers, const ENetPeer *peer)
+{
+  for (GameServerInfo &server : servers)
+    if (server.peer == peer)
+      return &server;
+  return nullptr;
+}
+
+// A game server runs a single world, so a session needs an instance of its own: nobody playing
+// or on the way there, and room for `seats`. Of those, the one with the least tick load.
+static GameServerInfo *pick_server(std::vector<GameServerInfo> &servers, int seats)
+{
+  GameServerInfo *best = nullptr;
+  for (GameServerInfo &server : servers)
+    if (server.players == 0 && server.pending == 0 && server.capacity >= seats &&
+        (!best || load(server) < load(*best)))
+      best = &server;
+  return best;
+}
+
+static void send_to_server(const std::vector<ENetPeer*> &peers, GameServerInfo &server, uint32_t now)
+{
+  std::string gameServerMsg = "GAMESERVER " + server.host + " " + std::to_string(server.port);
+  ENetPacket* packet = enet_packet_create(gameServerMsg.c_str(),
+                                         gameServerMsg.length() + 1,
+                                         ENET_PACKET_FLAG_RELIABLE);
+  server.pending += int(multicast_packet(peers, 0, packet));
+  server.lastAssigned = now;
+  printf("Session of %zu player(s) sent to game server %s:%d (%d/%d seats, load %.2f)\n", peers.size(),
+         server.host.c_str(), server.port, server.players + server.pending, server.capacity, load(server));
+}
+
+static void drop_server(std::vector<GameServerInfo> &servers, const ENetPeer *peer)
+{
+  GameServerInfo *server = find_server(servers, peer);
+  if (!server)
+    return;
+  printf("Game server %s:%d left the pool\n", server->host.c_str(), server->port);
+  servers.erase(servers.begin() + (server - servers.data()));
+}
+
+using PlayerQueue = MatchQueue<ENetPeer*>;
+
+// A queued player's ticket lives in peer->data; null once it left the queue
+static PlayerQueue::Ticket ticket_of(const ENetPeer *peer)
+{
+  return PlayerQueue::Ticket(uintptr_t(peer->data));
+}
+
+struct MatchConfig
+{
+  size_t groupSize = 4;
+  uint32_t maxWaitMs = 10000; // then the longest waiting player goes with whoever is closest
 };
 
+// Every group becomes a session of its own on an idle instance with room for all of it;
+// groups wait in the queue while there is none. Full groups come out of a single RTT band; a player that waited maxWaitMs or asked
+// to start takes the nearest bands and, if the queue is short, a smaller group.
+static void match_players(PlayerQueue &queue, std::vector<GameServerInfo> &servers, const MatchConfig &config,
+                          uint32_t now)
+{
+  std::vector<ENetPeer*> group;
+  auto dispatch = [&](GameServerInfo &server)
+  {
+    for (ENetPeer *peer : group)
+      peer->data = nullptr;
+    send_to_server(group, server, now);
+  };
+
+  for (uint32_t band = 0; band < PlayerQueue::band_count; ++band)
+    while (queue.band_size(band) >= config.groupSize)
+    {
+      GameServerInfo *server = pick_server(servers, int(config.groupSize));
+      if (!server)
+        return;
+      queue.pop_group(band, config.groupSize, group);
+      dispatch(*server);
+    }
+
+  while (PlayerQueue::Ticket first = queue.due(now, config.maxWaitMs))
+  {
+    size_t size = std::min(config.groupSize, queue.size());
+    GameServerInfo *server = pick_server(servers, int(size));
+    if (!server)
+      return;
+    queue.pop_group(queue.band(first), size, group, first);
+    dispatch(*server);
+  }
+}
+
 int main(int argc, const char **argv)
 {
-  if (enet_initialize() != 0) 
+  if (enet_initialize() != 0)
   {
     printf("Cannot init ENet\n");
     return 1;
   }
-  
+
   ENetAddress address;
   address.host = ENET_HOST_ANY;
-  address.port = 10887;
-  ENetHost *server = enet_host_create(&address, 32, 2, 0, 0);
+  address.port = lobby_port;
+  ENetHost *server = enet_host_create(&address, lobby_max_peers, 2, 0, 0);
 
-  if (!server) 
+  if (!server)
   {
     printf("Cannot create ENet lobby server\n");
     return 1;
   }
   printf("Lobby server started on port %d\n", address.port);
-  
-  GameServerInfo gameServer;
-  gameServer.host = "localhost";
-  gameServer.port = 10888;
-  gameServer.sessionStarted = false;
-  
-  if (argc > 2) 
+
+  // lobby [-g group size] [-w max wait ms] [game server host port [capacity]]
+  MatchConfig config;
+  std::vector<const char*> positional;
+  for (int i = 1; i < argc; ++i)
   {
-    gameServer.host = argv[1];
-    gameServer.port = std::atoi(argv[2]);
+    if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+      config.groupSize = std::max(1, std::atoi(argv[++i]));
+    else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+      config.maxWaitMs = uint32_t(std::max(0, std::atoi(argv[++i])));
+    else
+      positional.push_back(argv[i]);
   }
-  printf("Game server will be at %s:%d\n", gameServer.host.c_str(), gameServer.port);
-  std::vector<ENetPeer*> connectedPeers;
+  printf("Sessions of %zu, max wait %u ms\n", config.groupSize, config.maxWaitMs);
 
-  while (true) 
+  std::vector<GameServerInfo> gameServers;
+  // By peer slot: connected with game_server_connect_data, so allowed to REGISTER
+  std::vector<bool> gameServerPeers(server->peerCount, false);
+  auto peer_slot = [&](const ENetPeer *peer) { return size_t(peer - server->peers); };
+
+  // A server given on the command line never heartbeats; only the lobby's own count of
+  // players sent there describes its load, so it takes at most `capacity` players in total.
+  // A game server started with the lobby's address registers instead and reports its seats.
+  if (positional.size() >= 2)
+  {
+    GameServerInfo gameServer = {nullptr, positional[0], std::atoi(positional[1]), 32, 0, 0, 0.f, 0, 0};
+    if (positional.size() > 2)
+      gameServer.capacity = std::atoi(positional[2]);
+    gameServers.push_back(gameServer);
+    printf("Static game server at %s:%d\n", gameServer.host.c_str(), gameServer.port);
+  }
+  PlayerQueue queue;
+
+  while (true)
   {
     ENetEvent event;
-    while (enet_host_service(server, &event, 10) > 0) 
+    while (enet_host_service(server, &event, 10) > 0)
     {
-      switch (event.type) 
+      uint32_t now = enet_time_get();
+      switch (event.type)
       {
-        case ENET_EVENT_TYPE_CONNECT: 
+        case ENET_EVENT_TYPE_CONNECT:
         {
-          printf("Client connected from %x:%u\n", event.peer->address.host, event.peer->address.port);
-          connectedPeers.push_back(event.peer);
-          if (gameServer.sessionStarted) 
+          if (event.data == game_server_connect_data)
           {
-            std::string gameServerMsg = "GAMESERVER " + gameServer.host + " " +  std::to_string(gameServer.port);
-            ENetPacket* packet = enet_packet_create(gameServerMsg.c_str(), 
-                                                   gameServerMsg.length() + 1, 
-                                                   ENET_PACKET_FLAG_RELIABLE);
-            enet_peer_send(event.peer, 0, packet);
-            printf("Sent game server info to new player: %s\n", gameServerMsg.c_str());
+            gameServerPeers[peer_slot(event.peer)] = true;
+            printf("Game server connected from %x:%u\n", event.peer->address.host, event.peer->address.port);
+            break;
           }
+          printf("Client connected from %x:%u\n", event.peer->address.host, event.peer->address.port);
+          event.peer->data = (void*)uintptr_t(queue.push(event.peer, event.peer->roundTripTime, now));
           break;
         }
-        case ENET_EVENT_TYPE_RECEIVE: 
+        case ENET_EVENT_TYPE_RECEIVE:
         {
-          printf("Packet received from %x:%u: '%s'\n", 
-                event.peer->address.host, 
-                event.peer->address.port, 
-                event.packet->data);
-          if (!gameServer.sessionStarted && 
-              strcmp((const char*)event.packet->data, "Start!") == 0) 
+          const char *data = (const char*)event.packet->data;
+          char host[256];
+          int port = 0, capacity = 0, players = 0, loadPermille = 0;
+          GameServerInfo *gameServer = find_server(gameServers, event.peer);
+          if (!gameServer && gameServerPeers[peer_slot(event.peer)] &&
+              sscanf(data, "REGISTER %255s %d %d", host, &port, &capacity) == 3)
           {
-            printf("Game session start requested!\n");
-            gameServer.sessionStarted = true;
-            std::string gameServerMsg = "GAMESERVER " + gameServer.host + " " + std::to_string(gameServer.port);
-            for (auto peer : connectedPeers) 
+            GameServerInfo registered = {event.peer, host, port, capacity, 0, 0, 0.f, now, 0};
+            // The static server registering itself takes over its entry, players in flight included
+            auto same = std::find_if(gameServers.begin(), gameServers.end(), [&](const GameServerInfo &other)
             {
-              ENetPacket* packet = enet_packet_create(gameServerMsg.c_str(), 
-                                                     gameServerMsg.length() + 1, 
-                                                     ENET_PACKET_FLAG_RELIABLE);
-              enet_peer_send(peer, 0, packet);
+              return !other.peer && other.host == registered.host && other.port == port;
+            });
+            if (same != gameServers.end())
+            {
+              registered.pending = same->pending;
+              registered.lastAssigned = same->lastAssigned;
+              gameServers.erase(same);
+            }
+            gameServers.push_back(registered);
+            printf("Game server %s:%d registered, %d seats\n", host, port, capacity);
+          }
+          else if (gameServer && sscanf(data, "HEARTBEAT %d %d", &players, &loadPermille) == 2)
+          {
+            gameServer->players = players;
+            gameServer->tickLoad = loadPermille * 0.001f;
+            gameServer->lastHeartbeat = now;
+            if (now - gameServer->lastAssigned > pending_grace_ms)
+              gameServer->pending = 0;
+          }
+          else
+          {
+            printf("Packet received from %x:%u: '%s'\n",
+                  event.peer->address.host,
+                  event.peer->address.port,
+                  event.packet->data);
+            if (ticket_of(event.peer) &&
+                strcmp(data, "Start!") == 0)
+            {
+              printf("Game session start requested!\n");
+              queue.promote(ticket_of(event.peer));
             }
-            printf("Sent game server info to all connected players: %s\n", gameServerMsg.c_str());
           }
           enet_packet_destroy(event.packet);
           break;
         }
-        case ENET_EVENT_TYPE_DISCONNECT: 
+        case ENET_EVENT_TYPE_DISCONNECT:
         {
           printf("Client disconnected from %x:%u\n", event.peer->address.host, event.peer->address.port);
-          auto it = std::find(connectedPeers.begin(), connectedPeers.end(), event.peer);
-          if (it != connectedPeers.end()) 
-          {
-            connectedPeers.erase(it);
-          }
+          drop_server(gameServers, event.peer);
+          gameServerPeers[peer_slot(event.peer)] = false;
+          if (ticket_of(event.peer))
+            queue.erase(ticket_of(event.peer));
           event.peer->data = nullptr;
           break;
         }
@@ -106,8 +265,26 @@ int main(int argc, const char **argv)
           break;
       }
     }
+
+    uint32_t now = enet_time_get();
+    for (size_t i = 0; i < gameServers.size();)
+    {
+      const GameServerInfo &gameServer = gameServers[i];
+      if (gameServer.peer && now - gameServer.lastHeartbeat > heartbeat_timeout_ms)
+      {
+        ENetPeer *peer = gameServer.peer;
+        enet_peer_reset(peer);
+        gameServerPeers[peer_slot(peer)] = false;
+        drop_server(gameServers, peer);
+      }
+      else
+        ++i;
+    }
+
+    queue.refresh(rtt_refresh_per_loop, [](const ENetPeer *peer) { return peer->roundTripTime; });
+    match_players(queue, gameServers, config, now);
   }
   enet_host_destroy(server);
   enet_deinitialize();
   return 0;
-}
\ No newline at end of file
+}
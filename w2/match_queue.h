@@ -0,0 +1,218 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Players waiting for a match, banded by round-trip time. Inside a band players are kept in
+// the order they entered it; a second list keeps the order they entered the queue. Both are
+// intrusive lists over one node array, so push, erase and moving a player between bands are
+// O(1) and forming a group costs O(group size + band_count) whatever the queue length.
+// A Ticket names a queued player; the caller keeps it (the lobby stores it in peer->data).
+template<typename T>
+class MatchQueue
+{
+public:
+  using Ticket = uint32_t; // 0 is never a valid ticket
+
+  static constexpr uint32_t band_count = 6;
+  // Upper RTT bound of each band in ms, the last band takes everything slower
+  static constexpr uint32_t band_limits[band_count] = {30, 60, 100, 150, 250, UINT32_MAX};
+
+  static uint32_t band_of(uint32_t rtt)
+  {
+    uint32_t band = 0;
+    while (rtt > band_limits[band])
+      ++band;
+    return band;
+  }
+
+  Ticket push(const T &value, uint32_t rtt, uint32_t now)
+  {
+    uint32_t idx;
+    if (freeHead != npos)
+    {
+      idx = freeHead;
+      freeHead = nodes[idx].arrival.next;
+    }
+    else
+    {
+      idx = uint32_t(nodes.size());
+      nodes.emplace_back();
+    }
+    Node &node = nodes[idx];
+    node.value = value;
+    node.band = band_of(rtt);
+    node.enqueued = now;
+    node.due = false;
+    link_back(bands[node.band], idx, &Node::inBand);
+    link_back(arrival, idx, &Node::arrival);
+    return idx + 1;
+  }
+
+  void erase(Ticket ticket)
+  {
+    uint32_t idx = ticket - 1;
+    Node &node = nodes[idx];
+    if (cursor == idx)
+      cursor = node.arrival.next;
+    unlink(bands[node.band], idx, &Node::inBand);
+    unlink(arrival, idx, &Node::arrival);
+    node.value = T{};
+    node.arrival.next = freeHead;
+    freeHead = idx;
+  }
+
+  // Moves the player to the tail of the band of its current RTT
+  void update_rtt(Ticket ticket, uint32_t rtt)
+  {
+    uint32_t idx = ticket - 1;
+    uint32_t band = band_of(rtt);
+    if (band == nodes[idx].band)
+      return;
+    unlink(bands[nodes[idx].band], idx, &Node::inBand);
+    nodes[idx].band = band;
+    link_back(bands[band], idx, &Node::inBand);
+  }
+
+  // Puts the player first in line and makes it due regardless of waiting time
+  void promote(Ticket ticket)
+  {
+    uint32_t idx = ticket - 1;
+    if (cursor == idx)
+      cursor = nodes[idx].arrival.next;
+    unlink(arrival, idx, &Node::arrival);
+    link_front(arrival, idx, &Node::arrival);
+    nodes[idx].due = true;
+  }
+
+  // First in line if it waited max_wait or was promoted, else 0. Nobody behind it can be due.
+  Ticket due(uint32_t now, uint32_t max_wait) const
+  {
+    if (arrival.head == npos)
+      return 0;
+    const Node &node = nodes[arrival.head];
+    return node.due || now - node.enqueued >= max_wait ? arrival.head + 1 : 0;
+  }
+
+  uint32_t band(Ticket ticket) const { return nodes[ticket - 1].band; }
+  size_t band_size(uint32_t band) const { return bands[band].size; }
+  size_t size() const { return arrival.size; }
+  bool empty() const { return arrival.size == 0; }
+
+  // Pops up to n players into out: `first` if given, then the oldest of `band`, then the
+  // neighbouring bands nearest in RTT, faster one first on a tie.
+  void pop_group(uint32_t band, size_t n, std::vector<T> &out, Ticket first = 0)
+  {
+    out.clear();
+    if (first && n > 0)
+    {
+      out.push_back(nodes[first - 1].value);
+      erase(first);
+    }
+    for (uint32_t dist = 0; out.size() < n && dist < band_count; ++dist)
+    {
+      if (band >= dist)
+        take(band - dist, n, out);
+      if (dist > 0 && band + dist < band_count)
+        take(band + dist, n, out);
+    }
+  }
+
+  // RTT settles over the first seconds of a connection, so queued players are re-banded a few
+  // at a time: walks `count` players round-robin in arrival order and calls rtt_of(value).
+  template<typename F>
+  void refresh(size_t count, F &&rtt_of)
+  {
+    for (size_t i = 0; i < count && arrival.size > 0; ++i)
+    {
+      if (cursor == npos)
+        cursor = arrival.head;
+      uint32_t idx = cursor;
+      cursor = nodes[idx].arrival.next;
+      update_rtt(idx + 1, rtt_of(nodes[idx].value));
+    }
+  }
+
+private:
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  struct Links
+  {
+    uint32_t prev = npos;
+    uint32_t next = npos;
+  };
+
+  struct Node
+  {
+    T value{};
+    Links inBand;
+    Links arrival; // doubles as the free list link
+    uint32_t band = 0;
+    uint32_t enqueued = 0;
+    bool due = false;
+  };
+
+  struct List
+  {
+    uint32_t head = npos;
+    uint32_t tail = npos;
+    size_t size = 0;
+  };
+
+  void link_back(List &list, uint32_t idx, Links Node::*links)
+  {
+    Links &l = nodes[idx].*links;
+    l.prev = list.tail;
+    l.next = npos;
+    if (list.tail != npos)
+      (nodes[list.tail].*links).next = idx;
+    else
+      list.head = idx;
+    list.tail = idx;
+    ++list.size;
+  }
+
+  void link_front(List &list, uint32_t idx, Links Node::*links)
+  {
+    Links &l = nodes[idx].*links;
+    l.prev = npos;
+    l.next = list.head;
+    if (list.head != npos)
+      (nodes[list.head].*links).prev = idx;
+    else
+      list.tail = idx;
+    list.head = idx;
+    ++list.size;
+  }
+
+  void unlink(List &list, uint32_t idx, Links Node::*links)
+  {
+    Links &l = nodes[idx].*links;
+    if (l.prev != npos)
+      (nodes[l.prev].*links).next = l.next;
+    else
+      list.head = l.next;
+    if (l.next != npos)
+      (nodes[l.next].*links).prev = l.prev;
+    else
+      list.tail = l.prev;
+    l.prev = l.next = npos;
+    --list.size;
+  }
+
+  void take(uint32_t band, size_t n, std::vector<T> &out)
+  {
+    while (out.size() < n && bands[band].head != npos)
+    {
+      uint32_t idx = bands[band].head;
+      out.push_back(nodes[idx].value);
+      erase(idx + 1);
+    }
+  }
+
+  std::vector<Node> nodes;
+  List bands[band_count];
+  List arrival;
+  uint32_t freeHead = npos;
+  uint32_t cursor = npos; // next player for refresh
+};
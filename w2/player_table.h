@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Players kept contiguous for iteration, plus an id-indexed slot array for O(1) lookup.
+// Erase moves the last player into the hole. Ids are small integers the game server reuses
+// after a player leaves, so the slot array never outgrows the peak player count.
+template<typename T>
+class PlayerTable {
+public:
+  T *find(uint16_t id) {
+    if (id >= slots.size() || slots[id] == npos)
+      return nullptr;
+    return &players[slots[id]];
+  }
+
+  // Returns the player with this id, appending a default one with the id set if it is new.
+  T &insert(uint16_t id) {
+    if (T *existing = find(id))
+      return *existing;
+    if (id >= slots.size())
+      slots.resize(id + 1, npos);
+    slots[id] = uint32_t(players.size());
+    players.emplace_back();
+    players.back().id = id;
+    return players.back();
+  }
+
+  bool erase(uint16_t id) {
+    if (!find(id))
+      return false;
+    const uint32_t hole = slots[id];
+    if (hole + 1 != players.size()) {
+      players[hole] = std::move(players.back());
+      slots[players[hole].id] = hole;
+    }
+    players.pop_back();
+    slots[id] = npos;
+    return true;
+  }
+
+  void clear() {
+    players.clear();
+    slots.clear();
+  }
+
+  size_t size() const { return players.size(); }
+  bool empty() const { return players.empty(); }
+
+  using iterator = typename std::vector<T>::iterator;
+  using const_iterator = typename std::vector<T>::const_iterator;
+
+  iterator begin() { return players.begin(); }
+  iterator end() { return players.end(); }
+  const_iterator begin() const { return players.begin(); }
+  const_iterator end() const { return players.end(); }
+
+private:
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  std::vector<T> players;
+  std::vector<uint32_t> slots;
+};
@@ -0,0 +1,66 @@
+#include "protocol.h"
+
+// Fixed-size messages are encoded on the stack; enet_packet_create copies them once.
+static void send_bytes(ENetPeer *peer, const uint8_t *data, size_t size, enet_uint32 flags) {
+  ENetPacket *packet = enet_packet_create(data, size, flags);
+  enet_peer_send(peer, 0, packet);
+}
+
+static ENetPacket *create_id_packet(MessageType type, uint16_t id) {
+  uint8_t buf[3];
+  uint8_t *ptr = wire::put<uint8_t>(buf, type);
+  wire::put<uint16_t>(ptr, id);
+  return enet_packet_create(buf, sizeof(buf), ENET_PACKET_FLAG_RELIABLE);
+}
+
+ENetPacket *create_new_player_packet(uint16_t id) {
+  return create_id_packet(E_SERVER_TO_CLIENT_NEW_PLAYER, id);
+}
+
+ENetPacket *create_player_left_packet(uint16_t id) {
+  return create_id_packet(E_SERVER_TO_CLIENT_PLAYER_LEFT, id);
+}
+
+void send_welcome(ENetPeer *peer, uint16_t id) {
+  enet_peer_send(peer, 0, create_id_packet(E_SERVER_TO_CLIENT_WELCOME, id));
+}
+
+void send_new_player(ENetPeer *peer, uint16_t id) {
+  enet_peer_send(peer, 0, create_new_player_packet(id));
+}
+
+void send_player_left(ENetPeer *peer, uint16_t id) {
+  enet_peer_send(peer, 0, create_player_left_packet(id));
+}
+
+void send_position(ENetPeer *peer, float x, float y) {
+  uint8_t buf[5];
+  uint8_t *ptr = wire::put<uint8_t>(buf, E_CLIENT_TO_SERVER_POSITION);
+  ptr = wire::put<int16_t>(ptr, quantize_position(x));
+  wire::put<int16_t>(ptr, quantize_position(y));
+  send_bytes(peer, buf, sizeof(buf), ENET_PACKET_FLAG_UNSEQUENCED);
+}
+
+MessageType get_packet_type(const ENetPacket *packet) {
+  if (packet->dataLength == 0 || packet->data[0] >= E_MESSAGE_TYPE_COUNT)
+    return E_MESSAGE_TYPE_COUNT;
+  return MessageType(packet->data[0]);
+}
+
+bool deserialize_player_id(const ENetPacket *packet, uint16_t &id) {
+  if (packet->dataLength < 3)
+    return false;
+  wire::get(packet->data + 1, id);
+  return true;
+}
+
+bool deserialize_position(const ENetPacket *packet, float &x, float &y) {
+  if (packet->dataLength < 5)
+    return false;
+  int16_t qx, qy;
+  const uint8_t *ptr = wire::get(packet->data + 1, qx);
+  wire::get(ptr, qy);
+  x = dequantize_position(qx);
+  y = dequantize_position(qy);
+  return true;
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include <enet/enet.h>
+#include <cstdint>
+#include <cstring>
+
+// Binary messages between the w2 game server and its clients. Every message starts with a
+// one-byte MessageType; fields follow in host byte order with no padding. Positions travel as
+// int16 fixed point with 1/8 pixel resolution, ids and pings as uint16.
+enum MessageType : uint8_t {
+  E_SERVER_TO_CLIENT_WELCOME = 0,   // id
+  E_SERVER_TO_CLIENT_PLAYERS,       // count, count * (id, x, y, ping)
+  E_SERVER_TO_CLIENT_NEW_PLAYER,    // id
+  E_SERVER_TO_CLIENT_PLAYER_LEFT,   // id
+  E_SERVER_TO_CLIENT_SNAPSHOT,      // count, count * (id, x, y)
+  E_SERVER_TO_CLIENT_PINGS,         // count, count * (id, ping)
+  E_CLIENT_TO_SERVER_POSITION,      // x, y
+  E_MESSAGE_TYPE_COUNT
+};
+
+// Game servers register with the lobby over a plain ENet connection carrying this connect
+// data, so the lobby never mistakes them for players; text messages follow (see lobby.cpp).
+constexpr enet_uint32 game_server_connect_data = 0x47535256; // "GSRV"
+constexpr enet_uint16 lobby_port = 10887;
+
+constexpr float position_scale = 8.f;
+
+inline int16_t quantize_position(float v) {
+  float q = v * position_scale;
+  q = q < INT16_MIN ? INT16_MIN : (q > INT16_MAX ? INT16_MAX : q);
+  return int16_t(q < 0.f ? q - 0.5f : q + 0.5f);
+}
+
+inline float dequantize_position(int16_t q) {
+  return q / position_scale;
+}
+
+inline uint16_t clamp_ping(uint32_t ping) {
+  return ping > UINT16_MAX ? UINT16_MAX : uint16_t(ping);
+}
+
+constexpr size_t player_entry_size = 8;  // id, x, y, ping
+constexpr size_t ping_entry_size = 4;    // id, ping
+constexpr size_t snapshot_entry_size = 6; // id, x, y
+
+namespace wire {
+  template<typename T>
+  inline uint8_t *put(uint8_t *dst, T v) {
+    memcpy(dst, &v, sizeof(T));
+    return dst + sizeof(T);
+  }
+
+  template<typename T>
+  inline const uint8_t *get(const uint8_t *src, T &v) {
+    memcpy(&v, src, sizeof(T));
+    return src + sizeof(T);
+  }
+}
+
+void send_welcome(ENetPeer *peer, uint16_t id);
+void send_new_player(ENetPeer *peer, uint16_t id);
+void send_player_left(ENetPeer *peer, uint16_t id);
+void send_position(ENetPeer *peer, float x, float y);
+
+// Packets that go to several peers at once; hand them to broadcast_packet/multicast_packet.
+ENetPacket *create_new_player_packet(uint16_t id);
+ENetPacket *create_player_left_packet(uint16_t id);
+
+// Returns E_MESSAGE_TYPE_COUNT for empty or unknown packets.
+MessageType get_packet_type(const ENetPacket *packet);
+
+// Deserializers return false when the packet is too short for the message.
+bool deserialize_player_id(const ENetPacket *packet, uint16_t &id);
+bool deserialize_position(const ENetPacket *packet, float &x, float &y);
+
+// Lists are written straight into the packet. Range is any sized range of players with
+// id, x, y and ping members.
+template<typename Range>
+void send_player_list(ENetPeer *peer, const Range &players) {
+  ENetPacket *packet = enet_packet_create(nullptr, 3 + players.size() * player_entry_size, ENET_PACKET_FLAG_RELIABLE);
+  uint8_t *ptr = wire::put<uint8_t>(packet->data, E_SERVER_TO_CLIENT_PLAYERS);
+  ptr = wire::put<uint16_t>(ptr, uint16_t(players.size()));
+  for (const auto &player : players) {
+    ptr = wire::put<uint16_t>(ptr, uint16_t(player.id));
+    ptr = wire::put<int16_t>(ptr, quantize_position(player.x));
+    ptr = wire::put<int16_t>(ptr, quantize_position(player.y));
+    ptr = wire::put<uint16_t>(ptr, clamp_ping(player.ping));
+  }
+  enet_peer_send(peer, 0, packet);
+}
+
+template<typename Range>
+ENetPacket *create_pings_packet(const Range &players) {
+  ENetPacket *packet = enet_packet_create(nullptr, 3 + players.size() * ping_entry_size, 0);
+  uint8_t *ptr = wire::put<uint8_t>(packet->data, E_SERVER_TO_CLIENT_PINGS);
+  ptr = wire::put<uint16_t>(ptr, uint16_t(players.size()));
+  for (const auto &player : players) {
+    ptr = wire::put<uint16_t>(ptr, uint16_t(player.id));
+    ptr = wire::put<uint16_t>(ptr, clamp_ping(player.ping));
+  }
+  return packet;
+}
+
+template<typename Range>
+void send_pings(ENetPeer *peer, const Range &players) {
+  enet_peer_send(peer, 0, create_pings_packet(players));
+}
+
+// World state of one tick: every player's position in one packet. The caller hands the same
+// packet to every peer; ENet refcounts it and frees it after the last send.
+template<typename Range>
+ENetPacket *create_snapshot_packet(const Range &players) {
+  ENetPacket *packet = enet_packet_create(nullptr, 3 + players.size() * snapshot_entry_size, ENET_PACKET_FLAG_UNSEQUENCED);
+  uint8_t *ptr = wire::put<uint8_t>(packet->data, E_SERVER_TO_CLIENT_SNAPSHOT);
+  ptr = wire::put<uint16_t>(ptr, uint16_t(players.size()));
+  for (const auto &player : players) {
+    ptr = wire::put<uint16_t>(ptr, uint16_t(player.id));
+    ptr = wire::put<int16_t>(ptr, quantize_position(player.x));
+    ptr = wire::put<int16_t>(ptr, quantize_position(player.y));
+  }
+  return packet;
+}
+
+// Calls fn(id, x, y, ping) for every entry; returns false if the packet is truncated.
+template<typename F>
+bool deserialize_player_list(const ENetPacket *packet, F &&fn) {
+  if (packet->dataLength < 3)
+    return false;
+  uint16_t count = 0;
+  const uint8_t *ptr = wire::get(packet->data + 1, count);
+  if (packet->dataLength < 3 + size_t(count) * player_entry_size)
+    return false;
+  for (uint16_t i = 0; i < count; ++i) {
+    uint16_t id, ping;
+    int16_t x, y;
+    ptr = wire::get(ptr, id);
+    ptr = wire::get(ptr, x);
+    ptr = wire::get(ptr, y);
+    ptr = wire::get(ptr, ping);
+    fn(id, dequantize_position(x), dequantize_position(y), ping);
+  }
+  return true;
+}
+
+// Calls fn(id, ping) for every entry; returns false if the packet is truncated.
+template<typename F>
+bool deserialize_pings(const ENetPacket *packet, F &&fn) {
+  if (packet->dataLength < 3)
+    return false;
+  uint16_t count = 0;
+  const uint8_t *ptr = wire::get(packet->data + 1, count);
+  if (packet->dataLength < 3 + size_t(count) * ping_entry_size)
+    return false;
+  for (uint16_t i = 0; i < count; ++i) {
+    uint16_t id, ping;
+    ptr = wire::get(ptr, id);
+    ptr = wire::get(ptr, ping);
+    fn(id, ping);
+  }
+  return true;
+}
+
+// Calls fn(id, x, y) for every entry; returns false if the packet is truncated.
+template<typename F>
+bool deserialize_snapshot(const ENetPacket *packet, F &&fn) {
+  if (packet->dataLength < 3)
+    return false;
+  uint16_t count = 0;
+  const uint8_t *ptr = wire::get(packet->data + 1, count);
+  if (packet->dataLength < 3 + size_t(count) * snapshot_entry_size)
+    return false;
+  for (uint16_t i = 0; i < count; ++i) {
+    uint16_t id;
+    int16_t x, y;
+    ptr = wire::get(ptr, id);
+    ptr = wire::get(ptr, x);
+    ptr = wire::get(ptr, y);
+    fn(id, dequantize_position(x), dequantize_position(y));
+  }
+  return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <enet/enet.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+// Fixed-timestep loop around an ENet host. Between ticks the host is serviced with a timeout
+// that ends at the next deadline; enet_host_service only takes whole milliseconds, so the last
+// fraction of a millisecond is slept off precisely. Ticks are numbered consecutively and each
+// stands for exactly one period. After an overrun the missed ticks run back to back, up to
+// maxCatchUp of them; anything beyond that is dropped and the schedule restarts from now, so the
+// simulation slows down instead of jumping and never spirals. Outgoing packets are flushed right
+// after the ticks so they leave on time rather than at the next service call.
+class TickScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Since the last resetStats()
+  struct Stats {
+    uint64_t ticks = 0;
+    uint64_t overruns = 0;   // ticks that took longer than a period
+    uint64_t caughtUp = 0;   // ticks that ran late back to back
+    uint64_t skipped = 0;    // ticks dropped after too long a stall
+    Clock::duration totalDuration{}, maxDuration{};
+    Clock::duration totalLateness{}, maxLateness{}; // tick start past its deadline
+    Clock::duration busy{};  // events plus ticks
+    Clock::time_point windowStart = Clock::now();
+
+    float load(Clock::time_point now) const {
+      return std::chrono::duration<float>(busy) / std::chrono::duration<float>(now - windowStart);
+    }
+  };
+
+  explicit TickScheduler(Clock::duration period, uint32_t maxCatchUp = 5)
+    : period(period), maxCatchUp(maxCatchUp), deadline(Clock::now() + period) {}
+
+  // Services the host until the next deadline, calling onEvent(ENetEvent&) for every event,
+  // then runs every due tick as onTick(tick index)
+  template<typename EventFn, typename TickFn>
+  void runOnce(ENetHost* host, EventFn&& onEvent, TickFn&& onTick) {
+    for (Clock::time_point now = Clock::now(); now < deadline; now = Clock::now()) {
+      auto remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+      if (remainingMs == 0) {
+        std::this_thread::sleep_until(deadline);
+        break;
+      }
+      ENetEvent event;
+      if (enet_host_service(host, &event, enet_uint32(remainingMs)) > 0) {
+        Clock::time_point eventStart = Clock::now();
+        onEvent(event);
+        Clock::duration busy = Clock::now() - eventStart;
+        stats.busy += busy;
+        busyTotal += busy;
+      }
+    }
+
+    uint32_t ran = 0;
+    Clock::time_point now = Clock::now();
+    while (deadline <= now && ran < maxCatchUp) {
+      Clock::duration lateness = now - deadline;
+      onTick(tick++);
+      Clock::time_point end = Clock::now();
+      Clock::duration duration = end - now;
+
+      ++stats.ticks;
+      stats.overruns += duration > period;
+      stats.caughtUp += ran > 0;
+      stats.totalDuration += duration;
+      stats.maxDuration = std::max(stats.maxDuration, duration);
+      stats.totalLateness += lateness;
+      stats.maxLateness = std::max(stats.maxLateness, lateness);
+      stats.busy += duration;
+      busyTotal += duration;
+
+      deadline += period;
+      ++ran;
+      now = end;
+    }
+    if (deadline <= now) {
+      uint64_t behind = uint64_t((now - deadline) / period) + 1;
+      stats.skipped += behind;
+      deadline += behind * period;
+    }
+    enet_host_flush(host);
+  }
+
+  const Stats& getStats() const { return stats; }
+  void resetStats() { stats = Stats{}; }
+  // Events plus ticks since construction, unaffected by resetStats(), for load windows of other lengths
+  Clock::duration totalBusy() const { return busyTotal; }
+  uint64_t currentTick() const { return tick; }
+  Clock::duration getPeriod() const { return period; }
+
+private:
+  Clock::duration period;
+  uint32_t maxCatchUp;
+  Clock::time_point deadline;
+  uint64_t tick = 0;
+  Stats stats;
+  Clock::duration busyTotal{};
+};
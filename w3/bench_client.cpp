@@ -0,0 +1,183 @@
+#include <enet/enet.h>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "bench_protocol.h"
+
+// Throughput and RTT sweep against w3_bench_server. For every probe size, delivery mode and
+// number of channels it keeps `window` probes in flight for a fixed time, spreading them over the
+// channels round-robin, and reports echoed probes per second, goodput (echoed payload bytes per
+// second, one direction), loss and RTT percentiles. A probe counts as lost, freeing its window
+// slot, once reorder_slack later probes came back or after loss_timeout_ns.
+//
+// w3_bench_client [host] [port] [seconds per run] [window]
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t probe_sizes[] = {16, 64, 256, 1024, 4096, 16384};
+static const size_t channel_counts[] = {1, 2, 8};
+constexpr uint64_t loss_timeout_ns = 500'000'000;
+constexpr uint32_t reorder_slack = 32;
+constexpr uint32_t drain_ms = 200;
+
+static uint64_t now_ns()
+{
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+struct RunResult
+{
+  uint64_t sent = 0;
+  uint64_t echoed = 0;  // before the run ended, the drain only settles losses
+  uint64_t lost = 0;
+  double seconds = 0.0;
+  std::vector<uint64_t> rttNs;
+};
+
+// Value at fraction q of the sorted samples
+static double percentile_ms(std::vector<uint64_t> &samples, double q)
+{
+  if (samples.empty())
+    return 0.0;
+  size_t idx = std::min(samples.size() - 1, size_t(q * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + idx, samples.end());
+  return samples[idx] * 1e-6;
+}
+
+static void send_probe(ENetPeer *peer, BenchMode mode, uint16_t run, uint32_t seq, size_t size, enet_uint8 channel)
+{
+  ENetPacket *packet = enet_packet_create(nullptr, size, bench_mode_flags(mode));
+  memset(packet->data, 0xa5, size);
+  write_bench_header(packet->data, BenchHeader{uint8_t(mode), run, seq, now_ns()});
+  if (enet_peer_send(peer, channel, packet) < 0)
+    enet_packet_destroy(packet);
+}
+
+static RunResult run_bench(ENetHost *client, ENetPeer *peer, uint16_t run, BenchMode mode, size_t size,
+                           size_t channels, uint32_t durationMs, size_t window)
+{
+  RunResult res;
+  std::vector<uint64_t> sentAt;    // by seq
+  std::vector<uint8_t> done;       // echoed or written off as lost
+  size_t oldest = 0, inFlight = 0;
+  uint32_t highestEchoed = 0;
+
+  Clock::time_point start = Clock::now();
+  Clock::time_point stop = start + std::chrono::milliseconds(durationMs);
+  Clock::time_point drainUntil = stop + std::chrono::milliseconds(drain_ms);
+  for (Clock::time_point now = start; now < drainUntil; now = Clock::now())
+  {
+    while (now < stop && inFlight < window)
+    {
+      uint32_t seq = uint32_t(sentAt.size());
+      sentAt.push_back(now_ns());
+      done.push_back(0);
+      send_probe(peer, mode, run, seq, size, enet_uint8(seq % channels));
+      ++inFlight;
+      ++res.sent;
+    }
+
+    ENetEvent event;
+    int serviced = enet_host_service(client, &event, inFlight >= window || now >= stop ? 1 : 0);
+    for (; serviced > 0; serviced = enet_host_check_events(client, &event))
+    {
+      if (event.type != ENET_EVENT_TYPE_RECEIVE)
+        continue;
+      BenchHeader hdr;
+      if (read_bench_header(event.packet, hdr) && hdr.run == run && hdr.seq < done.size() && !done[hdr.seq])
+      {
+        done[hdr.seq] = 1;
+        --inFlight;
+        highestEchoed = std::max(highestEchoed, hdr.seq);
+        if (Clock::now() < stop)
+        {
+          ++res.echoed;
+          res.rttNs.push_back(now_ns() - hdr.sentNs);
+        }
+      }
+      enet_packet_destroy(event.packet);
+    }
+
+    uint64_t expiry = now_ns() - loss_timeout_ns;
+    for (; oldest < sentAt.size() &&
+           (done[oldest] || sentAt[oldest] < expiry || highestEchoed >= oldest + reorder_slack); ++oldest)
+      if (!done[oldest])
+      {
+        done[oldest] = 1;
+        --inFlight;
+        ++res.lost;
+      }
+    if (now >= stop && inFlight == 0)
+      break;
+  }
+  res.lost += inFlight;
+  res.seconds = std::chrono::duration<double>(stop - start).count();
+  return res;
+}
+
+int main(int argc, const char **argv)
+{
+  if (enet_initialize() != 0)
+  {
+    printf("Cannot init ENet");
+    return 1;
+  }
+
+  const char *host = argc > 1 ? argv[1] : "localhost";
+  uint16_t port = argc > 2 ? uint16_t(std::atoi(argv[2])) : bench_port;
+  uint32_t durationMs = argc > 3 ? uint32_t(std::atof(argv[3]) * 1000.0) : 1000;
+  size_t window = argc > 4 ? size_t(std::max(1, std::atoi(argv[4]))) : 64;
+
+  ENetHost *client = enet_host_create(nullptr, 1, bench_max_channels, 0, 0);
+  if (!client)
+  {
+    printf("Cannot create ENet client\n");
+    return 1;
+  }
+
+  ENetAddress address;
+  enet_address_set_host(&address, host);
+  address.port = port;
+
+  ENetPeer *serverPeer = enet_host_connect(client, &address, bench_max_channels, 0);
+  ENetEvent event;
+  if (!serverPeer || enet_host_service(client, &event, 5000) <= 0 || event.type != ENET_EVENT_TYPE_CONNECT)
+  {
+    printf("Cannot connect to %s:%u\n", host, port);
+    return 1;
+  }
+  printf("Connected to %s:%u, %u ms per run, window %zu\n\n", host, port, durationMs, window);
+  printf("%6s %-15s %3s %10s %12s %8s %9s %9s %9s\n",
+         "size", "mode", "ch", "pkt/s", "goodput MB/s", "loss %", "rtt p50", "rtt p99", "rtt p999");
+
+  uint16_t run = 0;
+  for (size_t size : probe_sizes)
+    for (uint8_t mode = 0; mode < E_BENCH_MODE_COUNT; ++mode)
+      for (size_t channels : channel_counts)
+      {
+        RunResult res = run_bench(client, serverPeer, ++run, BenchMode(mode), size, channels, durationMs, window);
+        double pps = res.echoed / res.seconds;
+        double lossPct = res.sent ? 100.0 * res.lost / res.sent : 0.0;
+        double p50 = percentile_ms(res.rttNs, 0.5);
+        double p99 = percentile_ms(res.rttNs, 0.99);
+        double p999 = percentile_ms(res.rttNs, 0.999);
+        printf("%6zu %-15s %3zu %10.0f %12.2f %8.2f %7.3fms %7.3fms %7.3fms\n",
+               size, bench_mode_name(BenchMode(mode)), channels, pps, pps * size / 1e6, lossPct, p50, p99, p999);
+        fflush(stdout);
+      }
+
+  enet_peer_disconnect(serverPeer, 0);
+  while (enet_host_service(client, &event, 1000) > 0)
+  {
+    if (event.type == ENET_EVENT_TYPE_RECEIVE)
+      enet_packet_destroy(event.packet);
+    else if (event.type == ENET_EVENT_TYPE_DISCONNECT)
+      break;
+  }
+  enet_host_destroy(client);
+
+  atexit(enet_deinitialize);
+  return 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <enet/enet.h>
+#include <cstdint>
+#include <cstring>
+
+// Wire format shared by w3_bench_client and w3_bench_server. Every probe starts with a fixed
+// header followed by filler up to the probe size; the server echoes each probe unchanged, on the
+// channel it came in on and with the delivery mode named in the header.
+constexpr uint16_t bench_port = 53474;
+constexpr size_t bench_max_channels = 8;
+
+enum BenchMode : uint8_t
+{
+  E_BENCH_RELIABLE = 0,
+  E_BENCH_UNSEQUENCED,
+  E_BENCH_UNRELIABLE_FRAGMENT, // unreliable, and so are the fragments of large probes
+  E_BENCH_MODE_COUNT
+};
+
+inline const char *bench_mode_name(BenchMode mode)
+{
+  switch (mode)
+  {
+  case E_BENCH_RELIABLE: return "reliable";
+  case E_BENCH_UNSEQUENCED: return "unsequenced";
+  case E_BENCH_UNRELIABLE_FRAGMENT: return "unrel-fragment";
+  default: return "?";
+  }
+}
+
+inline enet_uint32 bench_mode_flags(BenchMode mode)
+{
+  switch (mode)
+  {
+  case E_BENCH_RELIABLE: return ENET_PACKET_FLAG_RELIABLE;
+  case E_BENCH_UNSEQUENCED: return ENET_PACKET_FLAG_UNSEQUENCED;
+  case E_BENCH_UNRELIABLE_FRAGMENT: return ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT;
+  default: return 0;
+  }
+}
+
+struct BenchHeader
+{
+  uint8_t mode;
+  uint16_t run;     // echoes of an earlier run arriving late are dropped
+  uint32_t seq;
+  uint64_t sentNs;  // client steady clock
+};
+
+constexpr size_t bench_header_size = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint64_t);
+
+inline void write_bench_header(uint8_t *ptr, const BenchHeader &hdr)
+{
+  memcpy(ptr, &hdr.mode, sizeof(uint8_t)); ptr += sizeof(uint8_t);
+  memcpy(ptr, &hdr.run, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+  memcpy(ptr, &hdr.seq, sizeof(uint32_t)); ptr += sizeof(uint32_t);
+  memcpy(ptr, &hdr.sentNs, sizeof(uint64_t)); ptr += sizeof(uint64_t);
+}
+
+inline bool read_bench_header(const ENetPacket *packet, BenchHeader &hdr)
+{
+  if (packet->dataLength < bench_header_size)
+    return false;
+  const uint8_t *ptr = packet->data;
+  memcpy(&hdr.mode, ptr, sizeof(uint8_t)); ptr += sizeof(uint8_t);
+  memcpy(&hdr.run, ptr, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+  memcpy(&hdr.seq, ptr, sizeof(uint32_t)); ptr += sizeof(uint32_t);
+  memcpy(&hdr.sentNs, ptr, sizeof(uint64_t)); ptr += sizeof(uint64_t);
+  return hdr.mode < E_BENCH_MODE_COUNT;
+}
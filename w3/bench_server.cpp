@@ -0,0 +1,68 @@
+#include <enet/enet.h>
+#include <iostream>
+#include "bench_protocol.h"
+
+// Echo side of the benchmark: sends every probe straight back. The received packet itself is
+// queued again, so the echo costs no allocation or copy on the server.
+int main(int argc, const char **argv)
+{
+  if (enet_initialize() != 0)
+  {
+    printf("Cannot init ENet");
+    return 1;
+  }
+  ENetAddress address;
+
+  address.host = ENET_HOST_ANY;
+  address.port = argc > 1 ? uint16_t(std::atoi(argv[1])) : bench_port;
+
+  ENetHost *server = enet_host_create(&address, 32, bench_max_channels, 0, 0);
+
+  if (!server)
+  {
+    printf("Cannot create ENet server\n");
+    return 1;
+  }
+  printf("Bench server listening on port %u\n", address.port);
+
+  uint64_t echoed = 0;
+  while (true)
+  {
+    ENetEvent event;
+    while (enet_host_service(server, &event, 10) > 0)
+    {
+      switch (event.type)
+      {
+      case ENET_EVENT_TYPE_CONNECT:
+        printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
+        break;
+      case ENET_EVENT_TYPE_RECEIVE:
+        {
+          BenchHeader hdr;
+          if (!read_bench_header(event.packet, hdr))
+          {
+            enet_packet_destroy(event.packet);
+            break;
+          }
+          event.packet->flags = bench_mode_flags(BenchMode(hdr.mode));
+          if (enet_peer_send(event.peer, event.channelID, event.packet) < 0)
+            enet_packet_destroy(event.packet);
+          ++echoed;
+        }
+        break;
+      case ENET_EVENT_TYPE_DISCONNECT:
+        printf("%x:%u disconnected, %llu probes echoed\n", event.peer->address.host, event.peer->address.port,
+               (unsigned long long)echoed);
+        echoed = 0;
+        break;
+      default:
+        break;
+      };
+    }
+  }
+
+  enet_host_destroy(server);
+
+  atexit(enet_deinitialize);
+  return 0;
+}
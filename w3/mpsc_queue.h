@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Bounded multi-producer single-consumer queue (Vyukov's bounded queue with a single consumer).
+// Every cell carries a sequence number telling whose turn it is: producers claim a position
+// with one CAS on the tail and publish by bumping the cell's sequence, the consumer reads cells
+// in order without any read-modify-write. Capacity must be a power of two.
+template<typename T, size_t Capacity>
+class MpscQueue
+{
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+  MpscQueue()
+  {
+    for (size_t i = 0; i < Capacity; ++i)
+      cells[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  // Any thread; false if the queue is full
+  bool push(const T &value)
+  {
+    size_t pos = tailIdx.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;)
+    {
+      cell = &cells[pos & (Capacity - 1)];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos);
+      if (diff == 0)
+      {
+        if (tailIdx.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (diff < 0)
+        return false;
+      else
+        pos = tailIdx.load(std::memory_order_relaxed);
+    }
+    cell->value = value;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer thread only; false if the queue is empty
+  bool pop(T &value)
+  {
+    Cell &cell = cells[headIdx & (Capacity - 1)];
+    if (cell.seq.load(std::memory_order_acquire) != headIdx + 1)
+      return false;
+    value = cell.value;
+    cell.seq.store(headIdx + Capacity, std::memory_order_release);
+    ++headIdx;
+    return true;
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  alignas(64) std::atomic<size_t> tailIdx{0};
+  alignas(64) size_t headIdx = 0;
+  Cell cells[Capacity];
+};
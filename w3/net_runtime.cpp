@@ -0,0 +1,172 @@
+#include "net_runtime.h"
+#include <algorithm>
+
+void NetWorker::send(PeerRef peer, enet_uint8 channel, ENetPacket *packet)
+{
+  runtime.post({NetRuntime::OutKind::Send, channel, peer, packet});
+}
+
+void NetWorker::broadcast(enet_uint8 channel, ENetPacket *packet)
+{
+  runtime.post({NetRuntime::OutKind::Broadcast, channel, PeerRef{0, 0}, packet});
+}
+
+void NetWorker::disconnect(PeerRef peer)
+{
+  runtime.post({NetRuntime::OutKind::Disconnect, 0, peer, nullptr});
+}
+
+// Sleeps on `wake` only after announcing it in `sleeping` and finding the inbox still empty;
+// the network thread publishes events before it reads `sleeping`, so with the fences on both
+// sides one of the two always sees the other and no wake-up is lost.
+void NetWorker::run()
+{
+  NetEvent event;
+  while (true)
+  {
+    uint32_t ticket = wake.load(std::memory_order_acquire);
+    if (inbox.pop(event))
+    {
+      runtime.handler(*this, event);
+      continue;
+    }
+    if (!runtime.running.load(std::memory_order_acquire))
+      break;
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (inbox.empty() && runtime.running.load(std::memory_order_acquire))
+      wake.wait(ticket, std::memory_order_acquire);
+    sleeping.store(false, std::memory_order_relaxed);
+  }
+}
+
+NetRuntime::NetRuntime(ENetHost *host, size_t workerCount, NetHandler handler)
+  : host(host), handler(std::move(handler)), slotConnectIds(host->peerCount, 0)
+{
+  for (size_t i = 0; i < std::max<size_t>(workerCount, 1); ++i)
+    workers.emplace_back(new NetWorker(*this, i));
+  for (auto &worker : workers)
+    worker->thread = std::thread([w = worker.get()] { w->run(); });
+}
+
+NetRuntime::~NetRuntime()
+{
+  stop();
+  for (auto &worker : workers)
+  {
+    worker->wake.fetch_add(1, std::memory_order_release);
+    worker->wake.notify_one();
+    worker->thread.join();
+    for (NetEvent &event : worker->overflow)
+      if (event.packet)
+        enet_packet_destroy(event.packet);
+  }
+  Outgoing out;
+  while (outbox.pop(out))
+    if (out.packet && out.packet->referenceCount == 0)
+      enet_packet_destroy(out.packet);
+}
+
+void NetRuntime::stop()
+{
+  running.store(false, std::memory_order_release);
+}
+
+void NetRuntime::post(const Outgoing &out)
+{
+  while (!outbox.push(out))
+    std::this_thread::yield();
+}
+
+void NetRuntime::run()
+{
+  while (running.load(std::memory_order_acquire))
+  {
+    Outgoing out;
+    while (outbox.pop(out))
+      apply(out);
+
+    for (auto &worker : workers)
+      while (!worker->overflow.empty() && worker->inbox.push(worker->overflow.front()))
+      {
+        worker->overflow.pop_front();
+        worker->notify = true;
+      }
+
+    ENetEvent event;
+    int serviced = enet_host_service(host, &event, service_timeout_ms);
+    for (; serviced > 0; serviced = enet_host_check_events(host, &event))
+      dispatch(event);
+    wake_workers();
+  }
+}
+
+void NetRuntime::dispatch(const ENetEvent &event)
+{
+  uint16_t slot = uint16_t(event.peer - host->peers);
+  // ENet resets the peer, connect id included, before reporting its disconnect
+  if (event.type == ENET_EVENT_TYPE_CONNECT)
+    slotConnectIds[slot] = event.peer->connectID;
+
+  NetEvent netEvent;
+  netEvent.type = event.type;
+  netEvent.peer = PeerRef{slot, slotConnectIds[slot]};
+  netEvent.address = event.peer->address;
+  netEvent.channel = event.channelID;
+  netEvent.packet = event.type == ENET_EVENT_TYPE_RECEIVE ? event.packet : nullptr;
+  ++counters.events;
+  deliver(*workers[slot % workers.size()], netEvent);
+}
+
+void NetRuntime::deliver(NetWorker &worker, const NetEvent &event)
+{
+  if (!worker.overflow.empty() || !worker.inbox.push(event))
+  {
+    worker.overflow.push_back(event);
+    ++counters.overflowed;
+  }
+  worker.notify = true;
+}
+
+void NetRuntime::apply(const Outgoing &out)
+{
+  if (out.kind == OutKind::Broadcast)
+  {
+    enet_host_broadcast(host, out.channel, out.packet);
+    ++counters.sent;
+    return;
+  }
+
+  ENetPeer *peer = out.peer.slot < host->peerCount ? &host->peers[out.peer.slot] : nullptr;
+  bool live = peer && peer->state == ENET_PEER_STATE_CONNECTED && peer->connectID == out.peer.connectId;
+  if (out.kind == OutKind::Disconnect)
+  {
+    if (live)
+      enet_peer_disconnect(peer, 0);
+    return;
+  }
+  if (live && enet_peer_send(peer, out.channel, out.packet) == 0)
+  {
+    ++counters.sent;
+    return;
+  }
+  ++counters.stale;
+  if (out.packet->referenceCount == 0)
+    enet_packet_destroy(out.packet);
+}
+
+void NetRuntime::wake_workers()
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for (auto &worker : workers)
+  {
+    if (!worker->notify)
+      continue;
+    worker->notify = false;
+    if (worker->sleeping.load(std::memory_order_relaxed))
+    {
+      worker->wake.fetch_add(1, std::memory_order_release);
+      worker->wake.notify_one();
+    }
+  }
+}
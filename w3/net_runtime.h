@@ -0,0 +1,116 @@
+#pragma once
+#include <enet/enet.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "spsc_queue.h"
+#include "mpsc_queue.h"
+
+// Server runtime that keeps ENet servicing away from packet handling. The calling thread runs
+// the network loop and is the only one touching the ENetHost and its peers; handlers run on a
+// pool of workers. Received events go to the worker owning the peer (peer slot % workers, so a
+// peer's events stay in order and its state needs no locking) through an SPSC ring per worker;
+// outgoing packets come back through one MPSC queue drained on every loop. A slow handler
+// therefore delays only its own peers, never ENet's acks and keepalives.
+
+// A peer as workers see it. ENet reuses peer slots, so the slot comes with the connect id of the
+// connection it was taken from; sends to a connection that is gone are dropped.
+struct PeerRef
+{
+  uint16_t slot;
+  enet_uint32 connectId;
+};
+
+struct NetEvent
+{
+  ENetEventType type;
+  PeerRef peer;
+  ENetAddress address;
+  enet_uint8 channel;
+  ENetPacket *packet;  // receive only; owned by the handler, which must destroy it
+};
+
+class NetWorker;
+using NetHandler = std::function<void(NetWorker &worker, NetEvent &event)>;
+
+class NetRuntime;
+
+class NetWorker
+{
+public:
+  // Hand a packet to the network thread; it takes ownership like enet_peer_send does
+  void send(PeerRef peer, enet_uint8 channel, ENetPacket *packet);
+  void broadcast(enet_uint8 channel, ENetPacket *packet);
+  void disconnect(PeerRef peer);
+  size_t index() const { return idx; }
+
+private:
+  friend class NetRuntime;
+  static constexpr size_t inbox_capacity = 4096;
+
+  NetWorker(NetRuntime &runtime, size_t idx) : runtime(runtime), idx(idx) {}
+  void run();
+
+  NetRuntime &runtime;
+  size_t idx;
+  SpscQueue<NetEvent, inbox_capacity> inbox;
+  std::deque<NetEvent> overflow;     // network thread only: events that found the inbox full
+  alignas(64) std::atomic<uint32_t> wake{0};
+  std::atomic<bool> sleeping{false};
+  bool notify = false;               // network thread only: got events since the last wake-up
+  std::thread thread;
+};
+
+class NetRuntime
+{
+public:
+  struct Stats
+  {
+    uint64_t events = 0;
+    uint64_t overflowed = 0;   // events parked because a worker inbox was full
+    uint64_t sent = 0;
+    uint64_t stale = 0;        // sends to a connection that had already gone
+  };
+
+  NetRuntime(ENetHost *host, size_t workers, NetHandler handler);
+  ~NetRuntime();
+
+  // Runs the network loop on the calling thread until stop()
+  void run();
+  // Any thread
+  void stop();
+  const Stats &stats() const { return counters; }
+
+private:
+  friend class NetWorker;
+  static constexpr size_t outbox_capacity = 8192;
+  // ENet cannot be woken from its wait, so worker sends wait at most this long to go out
+  static constexpr enet_uint32 service_timeout_ms = 1;
+
+  enum class OutKind : uint8_t { Send, Broadcast, Disconnect };
+  struct Outgoing
+  {
+    OutKind kind;
+    enet_uint8 channel;
+    PeerRef peer;
+    ENetPacket *packet;
+  };
+
+  void post(const Outgoing &out);
+  void dispatch(const ENetEvent &event);
+  void deliver(NetWorker &worker, const NetEvent &event);
+  void apply(const Outgoing &out);
+  void wake_workers();
+
+  ENetHost *host;
+  NetHandler handler;
+  std::vector<std::unique_ptr<NetWorker>> workers;
+  MpscQueue<Outgoing, outbox_capacity> outbox;
+  std::vector<enet_uint32> slotConnectIds; // network thread only, as of each slot's last connect
+  std::atomic<bool> running{true};
+  Stats counters;
+};
@@ -1,5 +1,7 @@
 #include <enet/enet.h>
 #include <iostream>
+#include <algorithm>
+#include "net_runtime.h"
 
 int main(int argc, const char **argv)
 {
@@ -21,25 +23,24 @@ int main(int argc, const char **argv)
     return 1;
   }
 
-  while (true)
+  // Packets are parsed and printed on the workers; this thread only services ENet
+  size_t workers = argc > 1 ? size_t(std::max(1, std::atoi(argv[1]))) : 2;
+  NetRuntime runtime(server, workers, [](NetWorker &, NetEvent &event)
   {
-    ENetEvent event;
-    while (enet_host_service(server, &event, 10) > 0)
+    switch (event.type)
     {
-      switch (event.type)
-      {
-      case ENET_EVENT_TYPE_CONNECT:
-        printf("Connection with %x:%u established\n", event.peer->address.host, event.peer->address.port);
-        break;
-      case ENET_EVENT_TYPE_RECEIVE:
-        printf("Packet received '%s'\n", event.packet->data);
-        enet_packet_destroy(event.packet);
-        break;
-      default:
-        break;
-      };
-    }
-  }
+    case ENET_EVENT_TYPE_CONNECT:
+      printf("Connection with %x:%u established\n", event.address.host, event.address.port);
+      break;
+    case ENET_EVENT_TYPE_RECEIVE:
+      printf("Packet received '%s'\n", event.packet->data);
+      enet_packet_destroy(event.packet);
+      break;
+    default:
+      break;
+    };
+  });
+  runtime.run();
 
   enet_host_destroy(server);
 
@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Bounded single-producer single-consumer ring. Each side owns one index and keeps a cached
+// copy of the other, so the shared cache lines are only read when the cached value says the
+// ring looks full (producer) or empty (consumer). Capacity must be a power of two.
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+  // Producer side; false if the ring is full
+  bool push(const T &value)
+  {
+    size_t tail = tailIdx.load(std::memory_order_relaxed);
+    if (tail - cachedHead == Capacity)
+    {
+      cachedHead = headIdx.load(std::memory_order_acquire);
+      if (tail - cachedHead == Capacity)
+        return false;
+    }
+    slots[tail & (Capacity - 1)] = value;
+    tailIdx.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side; false if the ring is empty
+  bool pop(T &value)
+  {
+    size_t head = headIdx.load(std::memory_order_relaxed);
+    if (head == cachedTail)
+    {
+      cachedTail = tailIdx.load(std::memory_order_acquire);
+      if (head == cachedTail)
+        return false;
+    }
+    value = slots[head & (Capacity - 1)];
+    headIdx.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const
+  {
+    return headIdx.load(std::memory_order_acquire) == tailIdx.load(std::memory_order_acquire);
+  }
+
+private:
+  alignas(64) std::atomic<size_t> headIdx{0};
+  size_t cachedTail = 0;   // consumer's view of tailIdx
+  alignas(64) std::atomic<size_t> tailIdx{0};
+  size_t cachedHead = 0;   // producer's view of headIdx
+  alignas(64) T slots[Capacity];
+};
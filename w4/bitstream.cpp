@@ -1,4 +1,6 @@
 #include "bitstream.h"
+#include <algorithm>
+#include <bit>
 #include <cstring>
 #include <cmath>
 
@@ -9,85 +11,312 @@ BitStream::BitStream(const std::uint8_t* data, size_t size)
     buffer.assign(data, data + size);
 }
 
-void BitStream::WriteBit(bool value)
+BitStream BitStream::WrapStorage(std::uint8_t* storage, size_t capacity)
 {
-    const size_t byteIndex = m_WritePose / 8;
-    const size_t bitIndex = m_WritePose % 8;
+    BitStream bs;
+    bs.m_Storage = storage;
+    bs.m_StorageCapacity = capacity;
+    return bs;
+}
+
+namespace
+{
+    void store_le64(std::uint8_t* dst, uint64_t value)
+    {
+        if constexpr (std::endian::native == std::endian::little)
+            std::memcpy(dst, &value, sizeof(value));
+        else
+            for (size_t i = 0; i < sizeof(value); ++i)
+                dst[i] = std::uint8_t(value >> (i * 8));
+    }
+
+    uint64_t load_le64(const std::uint8_t* src)
+    {
+        uint64_t value = 0;
+        if constexpr (std::endian::native == std::endian::little)
+            std::memcpy(&value, src, sizeof(value));
+        else
+            for (size_t i = 0; i < sizeof(value); ++i)
+                value |= uint64_t(src[i]) << (i * 8);
+        return value;
+    }
 
-    if (byteIndex >= buffer.size())
-        buffer.push_back(0);
+    uint64_t low_bits(uint64_t value, uint8_t bitCount)
+    {
+        return bitCount < 64 ? value & ((uint64_t(1) << bitCount) - 1) : value;
+    }
+
+    size_t align_pose(size_t pose)
+    {
+        return (pose + 7) & ~size_t(7);
+    }
 
-    if (value)
-        buffer[byteIndex] |= (1 << bitIndex);
+    // Read side shared by BitStream and BitReader; pose is in bits. Malformed data makes these
+    // return false, leaving pose as is: BitStream throws on it, BitReader sets its error flag.
+    bool read_bits(const std::uint8_t* data, size_t size, size_t& pose, uint8_t bitCount, uint64_t& out)
+    {
+        out = 0;
+        if (bitCount == 0)
+            return true;
+        if (bitCount > 64)
+            throw std::invalid_argument("ReadBits: more than 64 bits");
+
+        const size_t byteIndex = pose / 8;
+        const size_t bitIndex = pose % 8;
+        if ((pose + bitCount + 7) / 8 > size)
+            return false;
+
+        const std::uint8_t* src = data + byteIndex;
+        uint64_t value;
+        if (byteIndex + 8 <= size)
+        {
+            value = load_le64(src) >> bitIndex;
+            // A word starting mid-byte holds only 64 - bitIndex of the requested bits
+            if (bitIndex + bitCount > 64)
+                value |= uint64_t(src[8]) << (64 - bitIndex);
+        }
+        else
+        {
+            std::uint8_t tail[8] = {};
+            std::memcpy(tail, src, size - byteIndex);
+            value = load_le64(tail) >> bitIndex;
+        }
+
+        pose += bitCount;
+        out = low_bits(value, bitCount);
+        return true;
+    }
+
+    // pose must be byte aligned
+    bool read_bytes(const std::uint8_t* data, size_t size, size_t& pose, void* dst, size_t count)
+    {
+        // Nothing to copy, and data or dst may be null
+        if (count == 0)
+            return true;
+        const size_t byteIndex = pose / 8;
+        if (count > size || byteIndex > size - count)
+            return false;
+
+        std::memcpy(dst, data + byteIndex, count);
+        pose += count * 8;
+        return true;
+    }
 
-    ++m_WritePose;
+    // The length is checked against what is left before anything is allocated for it
+    template<typename Reader>
+    bool read_string(Reader& reader, std::string& value)
+    {
+        uint32_t length = 0;
+        reader.template Read<uint32_t>(length);
+        value.clear();
+        if (length > reader.GetBitsLeft() / 8)
+            return false;
+
+        if (length > 0)
+        {
+            value.resize(length);
+            reader.ReadBytes(value.data(), length);
+        }
+        return true;
+    }
+
+    uint8_t bounded_bits(int64_t min, int64_t max)
+    {
+        if (max < min)
+            throw std::invalid_argument("Bounded: max below min");
+        return uint8_t(std::bit_width(uint64_t(max) - uint64_t(min)));
+    }
+
+    // False for a varint longer than ten groups or with payload past bit 63
+    template<typename Reader>
+    bool read_var_uint(Reader& reader, uint64_t& value)
+    {
+        value = 0;
+        for (uint32_t shift = 0; shift < 64; shift += 7)
+        {
+            const uint64_t group = reader.ReadBits(8);
+            // The tenth group carries bit 63 alone and has to be the last
+            if (shift == 63 && (group & 0xfe))
+                break;
+            value |= (group & 0x7f) << shift;
+            if (!(group & 0x80))
+                return true;
+        }
+        value = 0;
+        return false;
+    }
+
+    int64_t unzigzag(uint64_t value)
+    {
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
+    // False for a value outside [min, max]
+    template<typename Reader>
+    bool read_bounded(Reader& reader, int64_t min, int64_t max, int64_t& value)
+    {
+        const uint64_t offset = reader.ReadBits(bounded_bits(min, max));
+        if (offset > uint64_t(max) - uint64_t(min))
+        {
+            value = 0;
+            return false;
+        }
+        value = int64_t(uint64_t(min) + offset);
+        return true;
+    }
+
+    // Like read_string, checks the size before allocating
+    template<typename Reader>
+    bool read_bool_array(Reader& reader, std::vector<bool>& bools)
+    {
+        uint32_t size = 0;
+        reader.template Read<uint32_t>(size);
+        bools.clear();
+        if (size > reader.GetBitsLeft())
+            return false;
+
+        bools.resize(size);
+        for (size_t i = 0; i < size; i += 64)
+        {
+            const size_t count = std::min<size_t>(64, size - i);
+            const uint64_t word = reader.ReadBits(uint8_t(count));
+            for (size_t j = 0; j < count; ++j)
+                bools[i + j] = (word >> j) & 1;
+        }
+        return true;
+    }
 }
 
-bool BitStream::ReadBit()
+std::uint8_t* BitStream::Data()
 {
-    const size_t byteIndex = m_ReadPose / 8;
-    const size_t bitIndex = m_ReadPose % 8;
+    return m_Storage ? m_Storage : buffer.data();
+}
 
-    if (byteIndex >= buffer.size())
-        throw std::out_of_range("ReadBit: read beyond buffer");
+size_t BitStream::Size() const
+{
+    return m_Storage ? m_StorageSize : buffer.size();
+}
 
-    bool value = (buffer[byteIndex] >> bitIndex) & 1;
-    ++m_ReadPose;
+// Makes the first size bytes writable; storage supplied by the caller never grows
+void BitStream::Grow(size_t size)
+{
+    if (size <= Size())
+        return;
+    if (!m_Storage)
+        buffer.resize(size);
+    else if (size <= m_StorageCapacity)
+        m_StorageSize = size;
+    else
+        throw std::length_error("BitStream: write beyond external storage");
+}
 
-    return value;
+// Called once m_ScratchBits reached 64, before it is reduced; the register always starts at a
+// byte boundary in the buffer
+void BitStream::FlushWord()
+{
+    const size_t byteIndex = (m_WritePose - m_ScratchBits) / 8;
+    Grow(byteIndex + 8);
+    store_le64(Data() + byteIndex, m_Scratch);
 }
 
-void BitStream::WriteBits(uint32_t value, uint8_t bitCount)
+// Copies the pending bytes of the scratch register into the buffer, leaving the register as is:
+// later writes keep filling it and the next FlushWord overwrites these bytes.
+void BitStream::FlushBits()
 {
-    for (uint8_t i = 0; i < bitCount; ++i)
-        WriteBit((value >> i) & 1);
+    if (m_ScratchBits == 0)
+        return;
+
+    const size_t byteIndex = (m_WritePose - m_ScratchBits) / 8;
+    const size_t pending = (m_ScratchBits + 7) / 8;
+    Grow(byteIndex + pending);
+    std::uint8_t* dst = Data() + byteIndex;
+    for (size_t i = 0; i < pending; ++i)
+        dst[i] = std::uint8_t(m_Scratch >> (i * 8));
 }
 
-uint32_t BitStream::ReadBits(uint8_t bitCount)
+void BitStream::WriteBit(bool value)
 {
-    uint32_t value = 0;
-    for (uint8_t i = 0; i < bitCount; ++i)
-    {
-        if (ReadBit())
-            value |= (1u << i);
-    }
+    WriteBits(value, 1);
+}
+
+bool BitStream::ReadBit()
+{
+    return ReadBits(1) != 0;
+}
+
+void BitStream::WriteBits(uint64_t value, uint8_t bitCount)
+{
+    if (bitCount == 0)
+        return;
+    if (bitCount > 64)
+        throw std::invalid_argument("WriteBits: more than 64 bits");
+
+    value = low_bits(value, bitCount);
+    m_Scratch |= value << m_ScratchBits;
+    m_ScratchBits += bitCount;
+    m_WritePose += bitCount;
+    if (m_ScratchBits < 64)
+        return;
+
+    // The register is full: store it and keep the bits of value that did not fit
+    FlushWord();
+    m_ScratchBits -= 64;
+    m_Scratch = m_ScratchBits ? value >> (bitCount - m_ScratchBits) : 0;
+}
+
+uint64_t BitStream::ReadBits(uint8_t bitCount)
+{
+    // Reading back bits still sitting in the scratch register
+    if ((m_ReadPose + bitCount + 7) / 8 > Size())
+        FlushBits();
+    uint64_t value;
+    if (!read_bits(Data(), Size(), m_ReadPose, bitCount, value))
+        throw std::out_of_range("ReadBits: read beyond buffer");
     return value;
 }
 
 void BitStream::WriteBytes(const void* data, size_t size)
 {
     AlignWrite();
+    // An empty stream has no buffer to memcpy into yet
+    if (size == 0)
+        return;
+    FlushBits();
 
     const size_t byteIndex = m_WritePose / 8;
-    if (byteIndex + size > buffer.size())
-        buffer.resize(byteIndex + size);
+    Grow(byteIndex + size);
 
-    std::memcpy(buffer.data() + byteIndex, data, size);
+    std::memcpy(Data() + byteIndex, data, size);
     m_WritePose += size * 8;
+    m_Scratch = 0;
+    m_ScratchBits = 0;
 }
 
 void BitStream::ReadBytes(void* data, size_t size)
 {
     AlignRead();
-
-    const size_t byteIndex = m_ReadPose / 8;
-    if (byteIndex + size > buffer.size())
+    if (m_ReadPose / 8 + size > Size())
+        FlushBits();
+    if (!read_bytes(Data(), Size(), m_ReadPose, data, size))
         throw std::out_of_range("ReadBytes: read beyond buffer");
-
-    std::memcpy(data, buffer.data() + byteIndex, size);
-    m_ReadPose += size * 8;
 }
 
 void BitStream::AlignWrite()
 {
-    if (m_WritePose % 8)
-        m_WritePose = (m_WritePose + 7) & ~7;
+    const uint32_t padding = (8 - m_WritePose % 8) % 8;
+    m_WritePose += padding;
+    m_ScratchBits += padding;
+    if (m_ScratchBits == 64)
+    {
+        FlushWord();
+        m_ScratchBits = 0;
+        m_Scratch = 0;
+    }
 }
 
 void BitStream::AlignRead()
 {
-    if (m_ReadPose % 8)
-        m_ReadPose = (m_ReadPose + 7) & ~7;
+    m_ReadPose = align_pose(m_ReadPose);
 }
 
 void BitStream::Write(const std::string& value)
@@ -101,42 +330,92 @@ void BitStream::Write(const std::string& value)
 
 void BitStream::Read(std::string& value)
 {
-    uint32_t length = 0;
-    Read<uint32_t>(length);
+    if (!read_string(*this, value))
+        throw std::out_of_range("Read: string beyond buffer");
+}
 
-    if (length > 0)
-    {
-        value.resize(length);
-        ReadBytes(value.data(), length);
-    }
-    else
+void BitStream::WriteVarUint(uint64_t value)
+{
+    // Up to eight groups are packed into one WriteBits call
+    uint64_t packed = 0;
+    uint8_t bits = 0;
+    do
     {
-        value.clear();
-    }
+        uint64_t group = value & 0x7f;
+        value >>= 7;
+        if (value)
+            group |= 0x80;
+        packed |= group << bits;
+        bits += 8;
+        if (bits == 64)
+        {
+            WriteBits(packed, 64);
+            packed = 0;
+            bits = 0;
+        }
+    } while (value);
+    WriteBits(packed, bits);
+}
+
+uint64_t BitStream::ReadVarUint()
+{
+    uint64_t value;
+    if (!read_var_uint(*this, value))
+        throw std::out_of_range("ReadVarUint: varint longer than 64 bits");
+    return value;
+}
+
+void BitStream::WriteVarInt(int64_t value)
+{
+    WriteVarUint((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+}
+
+int64_t BitStream::ReadVarInt()
+{
+    return unzigzag(ReadVarUint());
+}
+
+void BitStream::WriteBounded(int64_t value, int64_t min, int64_t max)
+{
+    const uint8_t bits = bounded_bits(min, max);
+    if (value < min || value > max)
+        throw std::out_of_range("WriteBounded: value out of range");
+    WriteBits(uint64_t(value) - uint64_t(min), bits);
+}
+
+int64_t BitStream::ReadBounded(int64_t min, int64_t max)
+{
+    int64_t value;
+    if (!read_bounded(*this, min, max, value))
+        throw std::out_of_range("ReadBounded: value out of range");
+    return value;
 }
 
 void BitStream::WriteBoolArray(const std::vector<bool>& bools)
 {
     Write<uint32_t>(static_cast<uint32_t>(bools.size()));
-    for (bool b : bools)
-        WriteBit(b);
+    for (size_t i = 0; i < bools.size(); i += 64)
+    {
+        const size_t count = std::min<size_t>(64, bools.size() - i);
+        uint64_t word = 0;
+        for (size_t j = 0; j < count; ++j)
+            word |= uint64_t(bools[i + j]) << j;
+        WriteBits(word, uint8_t(count));
+    }
 }
 
 std::vector<bool> BitStream::ReadBoolArray()
 {
-    uint32_t size = 0;
-    Read<uint32_t>(size);
-
-    std::vector<bool> bools(size);
-    for (uint32_t i = 0; i < size; ++i)
-        bools[i] = ReadBit();
-
+    std::vector<bool> bools;
+    if (!read_bool_array(*this, bools))
+        throw std::out_of_range("ReadBoolArray: array beyond buffer");
     return bools;
 }
 
-const std::uint8_t* BitStream::GetData() const
+const std::uint8_t* BitStream::GetData()
 {
-    return buffer.data();
+    FlushBits();
+    return Data();
 }
 
 size_t BitStream::GetSizeBytes() const
@@ -149,9 +428,20 @@ size_t BitStream::GetSizeBits() const
     return m_WritePose;
 }
 
+// Streams built from received bytes have data but no write position
+size_t BitStream::GetBitsLeft() const
+{
+    const size_t end = std::max(Size() * 8, m_WritePose);
+    return m_ReadPose < end ? end - m_ReadPose : 0;
+}
+
 void BitStream::ResetWrite()
 {
+    buffer.clear();
+    m_StorageSize = 0;
     m_WritePose = 0;
+    m_Scratch = 0;
+    m_ScratchBits = 0;
 }
 
 void BitStream::ResetRead()
@@ -162,6 +452,116 @@ void BitStream::ResetRead()
 void BitStream::Clear()
 {
     buffer.clear();
+    m_StorageSize = 0;
     m_WritePose = 0;
     m_ReadPose = 0;
+    m_Scratch = 0;
+    m_ScratchBits = 0;
+}
+
+BitReader::BitReader(const std::uint8_t* data, size_t size)
+    : m_Data(data), m_Size(size)
+{
+}
+
+bool BitReader::HasError() const
+{
+    return m_Error;
+}
+
+void BitReader::SetError()
+{
+    m_Error = true;
+    m_ReadPose = m_Size * 8;
+}
+
+bool BitReader::ReadBit()
+{
+    return ReadBits(1) != 0;
+}
+
+uint64_t BitReader::ReadBits(uint8_t bitCount)
+{
+    uint64_t value;
+    if (!read_bits(m_Data, m_Size, m_ReadPose, bitCount, value)) [[unlikely]]
+        SetError();
+    return value;
+}
+
+void BitReader::ReadBytes(void* data, size_t size)
+{
+    AlignRead();
+    if (!read_bytes(m_Data, m_Size, m_ReadPose, data, size)) [[unlikely]]
+    {
+        std::memset(data, 0, size);
+        SetError();
+    }
+}
+
+void BitReader::AlignRead()
+{
+    m_ReadPose = align_pose(m_ReadPose);
+}
+
+void BitReader::Read(std::string& value)
+{
+    if (!read_string(*this, value)) [[unlikely]]
+        SetError();
+}
+
+uint64_t BitReader::ReadVarUint()
+{
+    uint64_t value;
+    if (!read_var_uint(*this, value)) [[unlikely]]
+        SetError();
+    // A varint cut short reads as its groups so far
+    return m_Error ? 0 : value;
+}
+
+int64_t BitReader::ReadVarInt()
+{
+    return unzigzag(ReadVarUint());
+}
+
+int64_t BitReader::ReadBounded(int64_t min, int64_t max)
+{
+    int64_t value;
+    if (!read_bounded(*this, min, max, value)) [[unlikely]]
+        SetError();
+    // A failed read would otherwise come out as min
+    return m_Error ? 0 : value;
+}
+
+std::vector<bool> BitReader::ReadBoolArray()
+{
+    std::vector<bool> bools;
+    if (!read_bool_array(*this, bools)) [[unlikely]]
+        SetError();
+    return bools;
+}
+
+const std::uint8_t* BitReader::GetData() const
+{
+    return m_Data;
+}
+
+size_t BitReader::GetSizeBytes() const
+{
+    return m_Size;
+}
+
+size_t BitReader::GetSizeBits() const
+{
+    return m_Size * 8;
+}
+
+size_t BitReader::GetBitsLeft() const
+{
+    return m_Size * 8 - m_ReadPose;
+}
+
+void BitReader::ResetRead()
+{
+    m_ReadPose = 0;
+    m_Error = false;
 }
@@ -0,0 +1,56 @@
+#pragma once
+#include <enet/enet.h>
+#include <cstddef>
+#include <initializer_list>
+
+// Fan-out of one packet to many peers. ENet refcounts a packet per queued send, so the
+// payload is serialized, allocated and copied once however many peers receive it.
+// Peers that are not connected or that appear in the exclude list are skipped, and a
+// packet that no peer took is destroyed here. Both return the number of receivers.
+
+inline bool is_excluded(const ENetPeer *peer, std::initializer_list<const ENetPeer*> exclude)
+{
+  for (const ENetPeer *excluded : exclude)
+    if (excluded == peer)
+      return true;
+  return false;
+}
+
+inline size_t finish_broadcast(ENetPacket *packet, size_t receivers)
+{
+  if (packet->referenceCount == 0)
+    enet_packet_destroy(packet);
+  return receivers;
+}
+
+// Every connected peer of the host.
+inline size_t broadcast_packet(ENetHost *host, enet_uint8 channel, ENetPacket *packet,
+                               std::initializer_list<const ENetPeer*> exclude = {})
+{
+  size_t receivers = 0;
+  for (size_t i = 0; i < host->peerCount; ++i)
+  {
+    ENetPeer *peer = &host->peers[i];
+    if (peer->state != ENET_PEER_STATE_CONNECTED || is_excluded(peer, exclude))
+      continue;
+    if (enet_peer_send(peer, channel, packet) == 0)
+      ++receivers;
+  }
+  return finish_broadcast(packet, receivers);
+}
+
+// An explicit set of peers, e.g. the members of one session. Range holds ENetPeer pointers.
+template<typename Range>
+size_t multicast_packet(const Range &peers, enet_uint8 channel, ENetPacket *packet,
+                        std::initializer_list<const ENetPeer*> exclude = {})
+{
+  size_t receivers = 0;
+  for (ENetPeer *peer : peers)
+  {
+    if (!peer || peer->state != ENET_PEER_STATE_CONNECTED || is_excluded(peer, exclude))
+      continue;
+    if (enet_peer_send(peer, channel, packet) == 0)
+      ++receivers;
+  }
+  return finish_broadcast(packet, receivers);
+}
@@ -22,7 +22,8 @@ static int winner_score = 0;
 void on_new_entity_packet(ENetPacket *packet)
 {
   Entity newEntity;
-  deserialize_new_entity(packet, newEntity);
+  if (!deserialize_new_entity(packet, newEntity))
+    return;
   auto itf = indexMap.find(newEntity.eid);
   if (itf != indexMap.end())
     return; // ничего не делаем если есть entity
@@ -32,7 +33,8 @@ void on_new_entity_packet(ENetPacket *packet)
 
 void on_set_controlled_entity(ENetPacket *packet)
 {
-  deserialize_set_controlled_entity(packet, my_entity);
+  if (!deserialize_set_controlled_entity(packet, my_entity))
+    return;
 }
 
 template<typename Callable>
@@ -47,7 +49,8 @@ void on_snapshot(ENetPacket *packet)
 {
   uint16_t eid = invalid_entity;
   float x = 0.f; float y = 0.f; float size = 0.f;
-  deserialize_snapshot(packet, eid, x, y, size);
+  if (!deserialize_snapshot(packet, eid, x, y, size))
+    return;
   get_entity(eid, [&](Entity& e)
   {
     e.x = x;
@@ -64,7 +67,8 @@ void on_entity_devoured(ENetPacket *packet)
   float new_x = 0.f;
   float new_y = 0.f;
   
-  deserialize_entity_devoured(packet, devoured_eid, devourer_eid, new_size, new_x, new_y);
+  if (!deserialize_entity_devoured(packet, devoured_eid, devourer_eid, new_size, new_x, new_y))
+    return;
   
   get_entity(devourer_eid, [&](Entity& e)
   {
@@ -84,7 +88,8 @@ void on_score_update(ENetPacket *packet)
   uint16_t eid = invalid_entity;
   int score = 0;
   
-  deserialize_score_update(packet, eid, score);
+  if (!deserialize_score_update(packet, eid, score))
+    return;
   
   get_entity(eid, [&](Entity& e)
   {
@@ -96,7 +101,8 @@ void on_game_time(ENetPacket *packet)
 {
   int seconds_remaining = 0;
   
-  deserialize_game_time(packet, seconds_remaining);
+  if (!deserialize_game_time(packet, seconds_remaining))
+    return;
   game_time_remaining = seconds_remaining;
 }
 
@@ -105,7 +111,8 @@ void on_game_over(ENetPacket *packet)
   uint16_t w_eid = invalid_entity;
   int w_score = 0;
   
-  deserialize_game_over(packet, w_eid, w_score);
+  if (!deserialize_game_over(packet, w_eid, w_score))
+    return;
   
   game_over = true;
   winner_eid = w_eid;
@@ -1,204 +1,226 @@
 #include "protocol.h"
-#include "bitstream.h"
+#include "message_schema.h"
 #include <cstring>
 #include <unordered_map>
 
+// Byte-aligned fields first, so the bit-packed tail needs no padding
+using NewEntitySchema = MessageSchema<Entity, E_SERVER_TO_CLIENT_NEW_ENTITY,
+                                      Field<&Entity::color, Raw>,
+                                      Field<&Entity::x, Raw>,
+                                      Field<&Entity::y, Raw>,
+                                      Field<&Entity::targetX, Raw>,
+                                      Field<&Entity::targetY, Raw>,
+                                      Field<&Entity::size, Raw>,
+                                      Field<&Entity::eid, VarUint>,
+                                      Field<&Entity::serverControlled, Bit>,
+                                      Field<&Entity::score, VarInt>>;
+
+using JoinSchema = MessageSchema<NoFields, E_CLIENT_TO_SERVER_JOIN>;
+
+struct SetControlledEntity { uint16_t eid; };
+using SetControlledEntitySchema = MessageSchema<SetControlledEntity, E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY,
+                                                Field<&SetControlledEntity::eid, Raw>>;
+
+struct EntityState { uint16_t eid; float x, y; };
+using EntityStateSchema = MessageSchema<EntityState, E_CLIENT_TO_SERVER_STATE,
+                                        Field<&EntityState::eid, Raw>,
+                                        Field<&EntityState::x, Raw>,
+                                        Field<&EntityState::y, Raw>>;
+
+struct Snapshot { uint16_t eid; float x, y, size; };
+using SnapshotSchema = MessageSchema<Snapshot, E_SERVER_TO_CLIENT_SNAPSHOT,
+                                     Field<&Snapshot::eid, Raw>,
+                                     Field<&Snapshot::x, Raw>,
+                                     Field<&Snapshot::y, Raw>,
+                                     Field<&Snapshot::size, Raw>>;
+
+struct EntityDevoured { uint16_t devouredEid, devourerEid; float newSize, newX, newY; };
+using EntityDevouredSchema = MessageSchema<EntityDevoured, E_SERVER_TO_CLIENT_ENTITY_DEVOURED,
+                                           Field<&EntityDevoured::devouredEid, Raw>,
+                                           Field<&EntityDevoured::devourerEid, Raw>,
+                                           Field<&EntityDevoured::newSize, Raw>,
+                                           Field<&EntityDevoured::newX, Raw>,
+                                           Field<&EntityDevoured::newY, Raw>>;
+
+struct ScoreUpdate { uint16_t eid; int score; };
+using ScoreUpdateSchema = MessageSchema<ScoreUpdate, E_SERVER_TO_CLIENT_SCORE_UPDATE,
+                                        Field<&ScoreUpdate::eid, VarUint>,
+                                        Field<&ScoreUpdate::score, VarInt>>;
+
+struct GameTime { int secondsRemaining; };
+using GameTimeSchema = MessageSchema<GameTime, E_SERVER_TO_CLIENT_GAME_TIME,
+                                     Field<&GameTime::secondsRemaining, VarInt>>;
+
+struct GameOver { uint16_t winnerEid; int winnerScore; };
+using GameOverSchema = MessageSchema<GameOver, E_SERVER_TO_CLIENT_GAME_OVER,
+                                     Field<&GameOver::winnerEid, VarUint>,
+                                     Field<&GameOver::winnerScore, VarInt>>;
+
 void send_join(ENetPeer *peer)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_CLIENT_TO_SERVER_JOIN);
+  enet_peer_send(peer, reliable_channel, create_message_packet<JoinSchema>({}, ENET_PACKET_FLAG_RELIABLE));
+}
 
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+ENetPacket *create_new_entity_packet(const Entity &ent)
+{
+  return create_message_packet<NewEntitySchema>(ent, ENET_PACKET_FLAG_RELIABLE);
 }
 
 void send_new_entity(ENetPeer *peer, const Entity &ent)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_NEW_ENTITY);
-  
-  bs.Write<uint32_t>(ent.color);
-  bs.Write<float>(ent.x);
-  bs.Write<float>(ent.y);
-  bs.Write<uint16_t>(ent.eid);
-  bs.Write<bool>(ent.serverControlled);
-  bs.Write<float>(ent.targetX);
-  bs.Write<float>(ent.targetY);
-  bs.Write<float>(ent.size);
-  bs.Write<int>(ent.score);
-
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+  enet_peer_send(peer, reliable_channel, create_new_entity_packet(ent));
 }
 
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY);
-  bs.Write<uint16_t>(eid);
-
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+  enet_peer_send(peer, reliable_channel,
+                 create_message_packet<SetControlledEntitySchema>({eid}, ENET_PACKET_FLAG_RELIABLE));
 }
 
 void send_entity_state(ENetPeer *peer, uint16_t eid, float x, float y)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_CLIENT_TO_SERVER_STATE);
-  bs.Write<uint16_t>(eid);
-  
-  bs.Write<float>(x);
-  bs.Write<float>(y);
+  enet_peer_send(peer, unreliable_channel,
+                 create_message_packet<EntityStateSchema>({eid, x, y}, ENET_PACKET_FLAG_UNSEQUENCED));
+}
 
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_UNSEQUENCED);
-  enet_peer_send(peer, 1, packet);
+ENetPacket *create_snapshot_packet(uint16_t eid, float x, float y, float size)
+{
+  return create_message_packet<SnapshotSchema>({eid, x, y, size}, ENET_PACKET_FLAG_UNSEQUENCED);
 }
 
 void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float size)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_SNAPSHOT);
-  bs.Write<uint16_t>(eid);
-  
-  bs.Write<float>(x);
-  bs.Write<float>(y);
-  bs.Write<float>(size); 
-
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_UNSEQUENCED);
-  enet_peer_send(peer, 1, packet);
+  enet_peer_send(peer, unreliable_channel, create_snapshot_packet(eid, x, y, size));
 }
 
 MessageType get_packet_type(ENetPacket *packet)
 {
+  if (packet->dataLength == 0)
+    return E_INVALID_PACKET;
   return (MessageType)*packet->data;
 }
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent)
+bool deserialize_new_entity(ENetPacket *packet, Entity &ent)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type); 
-  
-  bs.Read<uint32_t>(ent.color);
-  bs.Read<float>(ent.x);
-  bs.Read<float>(ent.y);
-  bs.Read<uint16_t>(ent.eid);
-  bs.Read<bool>(ent.serverControlled);
-  bs.Read<float>(ent.targetX);
-  bs.Read<float>(ent.targetY);
-  bs.Read<float>(ent.size);
-  bs.Read<int>(ent.score);
+  // Fields the schema does not carry keep the caller's values
+  Entity msg = ent;
+  if (!read_message_packet<NewEntitySchema>(packet, msg))
+    return false;
+  ent = msg;
+  return true;
 }
 
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
+bool deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint16_t>(eid);
+  SetControlledEntity msg;
+  if (!read_message_packet<SetControlledEntitySchema>(packet, msg))
+    return false;
+  eid = msg.eid;
+  return true;
 }
 
-void deserialize_entity_state(ENetPacket *packet, uint16_t &eid, float &x, float &y)
+bool deserialize_entity_state(ENetPacket *packet, uint16_t &eid, float &x, float &y)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint16_t>(eid);
-  bs.Read<float>(x);
-  bs.Read<float>(y);
+  EntityState msg;
+  if (!read_message_packet<EntityStateSchema>(packet, msg))
+    return false;
+  eid = msg.eid;
+  x = msg.x;
+  y = msg.y;
+  return true;
 }
 
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &size)
+bool deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &size)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint16_t>(eid);
-  bs.Read<float>(x);
-  bs.Read<float>(y);
-  bs.Read<float>(size); 
+  Snapshot msg;
+  if (!read_message_packet<SnapshotSchema>(packet, msg))
+    return false;
+  eid = msg.eid;
+  x = msg.x;
+  y = msg.y;
+  size = msg.size;
+  return true;
+}
+
+ENetPacket *create_entity_devoured_packet(uint16_t devoured_eid, uint16_t devourer_eid, float new_size, float new_x, float new_y)
+{
+  return create_message_packet<EntityDevouredSchema>({devoured_eid, devourer_eid, new_size, new_x, new_y},
+                                                      ENET_PACKET_FLAG_RELIABLE);
 }
 
 void send_entity_devoured(ENetPeer *peer, uint16_t devoured_eid, uint16_t devourer_eid, float new_size, float new_x, float new_y)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_ENTITY_DEVOURED);
-  bs.Write<uint16_t>(devoured_eid);
-  bs.Write<uint16_t>(devourer_eid);
-  bs.Write<float>(new_size);
-  bs.Write<float>(new_x);
-  bs.Write<float>(new_y);
+  enet_peer_send(peer, reliable_channel, create_entity_devoured_packet(devoured_eid, devourer_eid, new_size, new_x, new_y));
+}
 
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+bool deserialize_entity_devoured(ENetPacket *packet, uint16_t &devoured_eid, uint16_t &devourer_eid, float &new_size, float &new_x, float &new_y)
+{
+  EntityDevoured msg;
+  if (!read_message_packet<EntityDevouredSchema>(packet, msg))
+    return false;
+  devoured_eid = msg.devouredEid;
+  devourer_eid = msg.devourerEid;
+  new_size = msg.newSize;
+  new_x = msg.newX;
+  new_y = msg.newY;
+  return true;
 }
 
-void deserialize_entity_devoured(ENetPacket *packet, uint16_t &devoured_eid, uint16_t &devourer_eid, float &new_size, float &new_x, float &new_y)
+ENetPacket *create_score_update_packet(uint16_t eid, int score)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint16_t>(devoured_eid);
-  bs.Read<uint16_t>(devourer_eid);
-  bs.Read<float>(new_size);
-  bs.Read<float>(new_x);
-  bs.Read<float>(new_y);
+  return create_message_packet<ScoreUpdateSchema>({eid, score}, ENET_PACKET_FLAG_RELIABLE);
 }
 
 void send_score_update(ENetPeer *peer, uint16_t eid, int score)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_SCORE_UPDATE);
-  bs.Write<uint16_t>(eid);
-  bs.Write<int>(score);
+  enet_peer_send(peer, reliable_channel, create_score_update_packet(eid, score));
+}
 
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+bool deserialize_score_update(ENetPacket *packet, uint16_t &eid, int &score)
+{
+  ScoreUpdate msg;
+  if (!read_message_packet<ScoreUpdateSchema>(packet, msg))
+    return false;
+  eid = msg.eid;
+  score = msg.score;
+  return true;
 }
 
-void deserialize_score_update(ENetPacket *packet, uint16_t &eid, int &score)
+ENetPacket *create_game_time_packet(int seconds_remaining)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint16_t>(eid);
-  bs.Read<int>(score);
+  return create_message_packet<GameTimeSchema>({seconds_remaining}, ENET_PACKET_FLAG_RELIABLE);
 }
 
 void send_game_time(ENetPeer *peer, int seconds_remaining)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_GAME_TIME);
-  bs.Write<int>(seconds_remaining);
+  enet_peer_send(peer, reliable_channel, create_game_time_packet(seconds_remaining));
+}
 
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+ENetPacket *create_game_over_packet(uint16_t winner_eid, int winner_score)
+{
+  return create_message_packet<GameOverSchema>({winner_eid, winner_score}, ENET_PACKET_FLAG_RELIABLE);
 }
 
 void send_game_over(ENetPeer *peer, uint16_t winner_eid, int winner_score)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_GAME_OVER);
-  bs.Write<uint16_t>(winner_eid);
-  bs.Write<int>(winner_score);
-
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+  enet_peer_send(peer, reliable_channel, create_game_over_packet(winner_eid, winner_score));
 }
 
-void deserialize_game_over(ENetPacket *packet, uint16_t &winner_eid, int &winner_score)
+bool deserialize_game_over(ENetPacket *packet, uint16_t &winner_eid, int &winner_score)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint16_t>(winner_eid);
-  bs.Read<int>(winner_score);
+  GameOver msg;
+  if (!read_message_packet<GameOverSchema>(packet, msg))
+    return false;
+  winner_eid = msg.winnerEid;
+  winner_score = msg.winnerScore;
+  return true;
 }
 
-void deserialize_game_time(ENetPacket *packet, int &seconds_remaining)
+bool deserialize_game_time(ENetPacket *packet, int &seconds_remaining)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<int>(seconds_remaining);
-}
\ No newline at end of file
+  GameTime msg;
+  if (!read_message_packet<GameTimeSchema>(packet, msg))
+    return false;
+  seconds_remaining = msg.secondsRemaining;
+  return true;
+}
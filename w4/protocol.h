@@ -13,9 +13,14 @@ enum MessageType : uint8_t
   E_SERVER_TO_CLIENT_ENTITY_DEVOURED,
   E_SERVER_TO_CLIENT_SCORE_UPDATE,
   E_SERVER_TO_CLIENT_GAME_TIME,
-  E_SERVER_TO_CLIENT_GAME_OVER
+  E_SERVER_TO_CLIENT_GAME_OVER,
+  E_INVALID_PACKET = 0xff  // what get_packet_type reports for an empty packet
 };
 
+// Reliable messages go on channel 0, unsequenced state and snapshots on channel 1
+constexpr enet_uint8 reliable_channel = 0;
+constexpr enet_uint8 unreliable_channel = 1;
+
 void send_join(ENetPeer *peer);
 void send_new_entity(ENetPeer *peer, const Entity &ent);
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid);
@@ -27,14 +32,24 @@ void send_score_update(ENetPeer *peer, uint16_t eid, int score);
 void send_game_over(ENetPeer *peer, uint16_t winner_eid, int winner_score);
 void send_game_time(ENetPeer *peer, int seconds_remaining);
 
+// Packets for fan-out: serialize once and hand to broadcast_packet on the matching channel
+ENetPacket *create_new_entity_packet(const Entity &ent);                                   // reliable
+ENetPacket *create_snapshot_packet(uint16_t eid, float x, float y, float size);           // unreliable
+ENetPacket *create_entity_devoured_packet(uint16_t devoured_eid, uint16_t devourer_eid,
+                                          float new_size, float new_x, float new_y);     // reliable
+ENetPacket *create_score_update_packet(uint16_t eid, int score);                          // reliable
+ENetPacket *create_game_time_packet(int seconds_remaining);                               // reliable
+ENetPacket *create_game_over_packet(uint16_t winner_eid, int winner_score);               // reliable
+
 MessageType get_packet_type(ENetPacket *packet);
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent);
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
-void deserialize_entity_state(ENetPacket *packet, uint16_t &eid, float &x, float &y);
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &size);
+// These return false for a truncated or malformed packet, which should then be dropped
+bool deserialize_new_entity(ENetPacket *packet, Entity &ent);
+bool deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
+bool deserialize_entity_state(ENetPacket *packet, uint16_t &eid, float &x, float &y);
+bool deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &size);
 
-void deserialize_score_update(ENetPacket *packet, uint16_t &eid, int &score);
-void deserialize_entity_devoured(ENetPacket *packet, uint16_t &devoured_eid, uint16_t &devourer_eid, float &new_size, float &new_x, float &new_y);
-void deserialize_game_over(ENetPacket *packet, uint16_t &winner_eid, int &winner_score);
-void deserialize_game_time(ENetPacket *packet, int &seconds_remaining);
\ No newline at end of file
+bool deserialize_score_update(ENetPacket *packet, uint16_t &eid, int &score);
+bool deserialize_entity_devoured(ENetPacket *packet, uint16_t &devoured_eid, uint16_t &devourer_eid, float &new_size, float &new_x, float &new_y);
+bool deserialize_game_over(ENetPacket *packet, uint16_t &winner_eid, int &winner_score);
+bool deserialize_game_time(ENetPacket *packet, int &seconds_remaining);
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <enet/enet.h>
 #include "entity.h"
 #include "protocol.h"
+#include "enet_broadcast.h"
 #include <stdlib.h>
 #include <vector>
 #include <map>
@@ -52,8 +53,7 @@ void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
 
   controlledMap[newEid] = peer;
 
-  for (size_t i = 0; i < host->peerCount; ++i)
-    send_new_entity(&host->peers[i], ent);
+  broadcast_packet(host, reliable_channel, create_new_entity_packet(ent));
   send_set_controlled_entity(peer, newEid);
 }
 
@@ -61,7 +61,8 @@ void on_state(ENetPacket *packet)
 {
   uint16_t eid = invalid_entity;
   float x = 0.f; float y = 0.f;
-  deserialize_entity_state(packet, eid, x, y);
+  if (!deserialize_entity_state(packet, eid, x, y))
+    return;
   for (Entity &e : entities)
     if (e.eid == eid)
     {
@@ -109,10 +110,7 @@ int main()
       game_time_remaining--;
       last_time_update = curTime;
       
-      for (size_t i = 0; i < server->peerCount; ++i) {
-        ENetPeer *peer = &server->peers[i];
-        send_game_time(peer, game_time_remaining);
-      }
+      broadcast_packet(server, reliable_channel, create_game_time_packet(game_time_remaining));
       
       printf("Game time remaining: %d seconds\n", game_time_remaining);
       
@@ -132,10 +130,7 @@ int main()
         printf("Game over! Winner is entity %d with score %d\n", 
                winner_eid, highest_score);
                
-        for (size_t i = 0; i < server->peerCount; ++i) {
-          ENetPeer *peer = &server->peers[i];
-          send_game_over(peer, winner_eid, highest_score);
-        }
+        broadcast_packet(server, reliable_channel, create_game_over_packet(winner_eid, highest_score));
       }
     }
     
@@ -177,6 +172,8 @@ int main()
           case E_SERVER_TO_CLIENT_GAME_OVER:
             printf("Warning: Received server-to-client message on server\n");
             break;
+          case E_INVALID_PACKET:
+            break;
         };
         enet_packet_destroy(event.packet);
         break;
@@ -265,21 +262,14 @@ int main()
               devourer->score += static_cast<int>(size_gain);
             }
             
-            for (size_t k = 0; k < server->peerCount; ++k)
-            {
-              ENetPeer *peer = &server->peers[k];
-              send_score_update(peer, devourer->eid, devourer->score);
-            }
+            broadcast_packet(server, reliable_channel, create_score_update_packet(devourer->eid, devourer->score));
             
             devoured->x = (rand() % 100 - 50) * 10.f;
             devoured->y = (rand() % 100 - 50) * 10.f;
             
-            for (size_t k = 0; k < server->peerCount; ++k)
-            {
-              ENetPeer *peer = &server->peers[k];
-              send_entity_devoured(peer, devoured->eid, devourer->eid, 
-                                  devourer->size, devoured->x, devoured->y);
-            }
+            broadcast_packet(server, reliable_channel,
+                             create_entity_devoured_packet(devoured->eid, devourer->eid,
+                                                           devourer->size, devoured->x, devoured->y));
             
             collision_occurred = true;
           } else {
@@ -290,15 +280,10 @@ int main()
       }
     }
     
+    // The owner of an entity simulates it locally and does not need its snapshot
     for (const Entity &e : entities)
-    {
-      for (size_t i = 0; i < server->peerCount; ++i)
-      {
-        ENetPeer *peer = &server->peers[i];
-        if (controlledMap[e.eid] != peer)
-          send_snapshot(peer, e.eid, e.x, e.y, e.size);
-      }
-    }
+      broadcast_packet(server, unreliable_channel, create_snapshot_packet(e.eid, e.x, e.y, e.size),
+                       { controlledMap[e.eid] });
   }
 
   enet_host_destroy(server);
@@ -1,54 +1,72 @@
 #include <cstring>
 #include <chrono>
 #include "protocol.h"
-#include "bitstream.h"
+#include "message_schema.h"
+
+using JoinSchema = MessageSchema<NoFields, MessageType::ClientJoin>;
+
+using NewEntitySchema = MessageSchema<Entity, MessageType::ServerNewEntity,
+                                      Field<&Entity::color, Raw>,
+                                      Field<&Entity::x, Raw>,
+                                      Field<&Entity::y, Raw>,
+                                      Field<&Entity::vx, Raw>,
+                                      Field<&Entity::vy, Raw>,
+                                      Field<&Entity::ori, Raw>,
+                                      Field<&Entity::omega, Raw>,
+                                      Field<&Entity::thr, Raw>,
+                                      Field<&Entity::steer, Raw>,
+                                      Field<&Entity::eid, Raw>>;
+
+struct SetControlledEntity { uint16_t eid; };
+using SetControlledEntitySchema = MessageSchema<SetControlledEntity, MessageType::ServerSetControlled,
+                                                Field<&SetControlledEntity::eid, Raw>>;
+
+struct EntityInput { uint16_t eid; float thr, steer; };
+using EntityInputSchema = MessageSchema<EntityInput, MessageType::ClientInput,
+                                        Field<&EntityInput::eid, Raw>,
+                                        Field<&EntityInput::thr, Raw>,
+                                        Field<&EntityInput::steer, Raw>>;
+
+struct Snapshot
+{
+  uint16_t eid;
+  float x, y, ori, vx, vy, omega;
+  uint64_t timestampMs;
+  uint32_t frameNumber;
+};
+using SnapshotSchema = MessageSchema<Snapshot, MessageType::ServerSnapshot,
+                                     Field<&Snapshot::eid, Raw>,
+                                     Field<&Snapshot::x, Raw>,
+                                     Field<&Snapshot::y, Raw>,
+                                     Field<&Snapshot::ori, Raw>,
+                                     Field<&Snapshot::vx, Raw>,
+                                     Field<&Snapshot::vy, Raw>,
+                                     Field<&Snapshot::omega, Raw>,
+                                     Field<&Snapshot::timestampMs, Raw>,
+                                     Field<&Snapshot::frameNumber, Raw>>;
+
+struct TimeMsec { uint32_t timeMsec; };
+using TimeMsecSchema = MessageSchema<TimeMsec, MessageType::ServerTimeSync,
+                                     Field<&TimeMsec::timeMsec, Raw>>;
 
 void send_join(ENetPeer *peer)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_CLIENT_TO_SERVER_JOIN);
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+  enet_peer_send(peer, 0, create_message_packet<JoinSchema>({}, ENET_PACKET_FLAG_RELIABLE));
 }
 
 void send_new_entity(ENetPeer *peer, const Entity &ent)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_NEW_ENTITY);
-  bs.Write<uint32_t>(ent.color);
-  bs.Write<float>(ent.x);
-  bs.Write<float>(ent.y);
-  bs.Write<float>(ent.vx);
-  bs.Write<float>(ent.vy);
-  bs.Write<float>(ent.ori);
-  bs.Write<float>(ent.omega);
-  bs.Write<float>(ent.thr);
-  bs.Write<float>(ent.steer);
-  bs.Write<uint16_t>(ent.eid);
-
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+  enet_peer_send(peer, 0, create_message_packet<NewEntitySchema>(ent, ENET_PACKET_FLAG_RELIABLE));
 }
 
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY);
-  bs.Write<uint16_t>(eid);
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+  enet_peer_send(peer, 0, create_message_packet<SetControlledEntitySchema>({eid}, ENET_PACKET_FLAG_RELIABLE));
 }
 
 void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_CLIENT_TO_SERVER_INPUT);
-  bs.Write<uint16_t>(eid);
-  bs.Write<float>(thr);
-  bs.Write<float>(steer);
-
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_UNSEQUENCED);
-  enet_peer_send(peer, 1, packet);
+  enet_peer_send(peer, 1, create_message_packet<EntityInputSchema>({eid, thr, steer}, ENET_PACKET_FLAG_UNSEQUENCED));
 }
 
 void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori,
@@ -57,95 +75,75 @@ void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori,
   auto duration = timestamp.time_since_epoch();
   uint64_t timestamp_ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
 
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_SNAPSHOT);
-  bs.Write<uint16_t>(eid);
-  bs.Write<float>(x);
-  bs.Write<float>(y);
-  bs.Write<float>(ori);
-  bs.Write<float>(vx);
-  bs.Write<float>(vy);
-  bs.Write<float>(omega);
-  bs.Write<uint64_t>(timestamp_ms);
-  bs.Write<uint32_t>(frameNumber);
-
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_UNSEQUENCED);
-  enet_peer_send(peer, 1, packet);
+  Snapshot msg{eid, x, y, ori, vx, vy, omega, timestamp_ms, frameNumber};
+  enet_peer_send(peer, 1, create_message_packet<SnapshotSchema>(msg, ENET_PACKET_FLAG_UNSEQUENCED));
 }
 
 void send_time_msec(ENetPeer *peer, uint32_t timeMsec)
 {
-  BitStream bs;
-  bs.Write<uint8_t>(E_SERVER_TO_CLIENT_TIME_MSEC);
-  bs.Write<uint32_t>(timeMsec);
-
-  ENetPacket *packet = enet_packet_create(bs.GetData(), bs.GetSizeBytes(), ENET_PACKET_FLAG_RELIABLE);
-  enet_peer_send(peer, 0, packet);
+  enet_peer_send(peer, 0, create_message_packet<TimeMsecSchema>({timeMsec}, ENET_PACKET_FLAG_RELIABLE));
 }
 
 MessageType get_packet_type(ENetPacket *packet)
 {
+  if (packet->dataLength == 0)
+    return MessageType::Invalid;
   return static_cast<MessageType>(*packet->data);
 }
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent)
+bool deserialize_new_entity(ENetPacket *packet, Entity &ent)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint32_t>(ent.color);
-  bs.Read<float>(ent.x);
-  bs.Read<float>(ent.y);
-  bs.Read<float>(ent.vx);
-  bs.Read<float>(ent.vy);
-  bs.Read<float>(ent.ori);
-  bs.Read<float>(ent.omega);
-  bs.Read<float>(ent.thr);
-  bs.Read<float>(ent.steer);
-  bs.Read<uint16_t>(ent.eid);
+  // Fields the schema does not carry keep the caller's values
+  Entity msg = ent;
+  if (!read_message_packet<NewEntitySchema>(packet, msg))
+    return false;
+  ent = msg;
+  return true;
 }
 
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
+bool deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint16_t>(eid);
+  SetControlledEntity msg;
+  if (!read_message_packet<SetControlledEntitySchema>(packet, msg))
+    return false;
+  eid = msg.eid;
+  return true;
 }
 
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer)
+bool deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint16_t>(eid);
-  bs.Read<float>(thr);
-  bs.Read<float>(steer);
+  EntityInput msg;
+  if (!read_message_packet<EntityInputSchema>(packet, msg))
+    return false;
+  eid = msg.eid;
+  thr = msg.thr;
+  steer = msg.steer;
+  return true;
 }
 
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori,
+bool deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori,
                           float &vx, float &vy, float &omega, TimePoint &timestamp, uint32_t &frameNumber)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint16_t>(eid);
-  bs.Read<float>(x);
-  bs.Read<float>(y);
-  bs.Read<float>(ori);
-  bs.Read<float>(vx);
-  bs.Read<float>(vy);
-  bs.Read<float>(omega);
-  uint64_t timestamp_ms = 0;
-  bs.Read<uint64_t>(timestamp_ms);
-  bs.Read<uint32_t>(frameNumber);
-  timestamp = TimePoint(std::chrono::milliseconds(timestamp_ms));
+  Snapshot msg;
+  if (!read_message_packet<SnapshotSchema>(packet, msg))
+    return false;
+  eid = msg.eid;
+  x = msg.x;
+  y = msg.y;
+  ori = msg.ori;
+  vx = msg.vx;
+  vy = msg.vy;
+  omega = msg.omega;
+  frameNumber = msg.frameNumber;
+  timestamp = TimePoint(std::chrono::milliseconds(msg.timestampMs));
+  return true;
 }
 
-void deserialize_time_msec(ENetPacket *packet, uint32_t &timeMsec)
+bool deserialize_time_msec(ENetPacket *packet, uint32_t &timeMsec)
 {
-  BitStream bs(packet->data, packet->dataLength);
-  uint8_t type;
-  bs.Read<uint8_t>(type);
-  bs.Read<uint32_t>(timeMsec);
+  TimeMsec msg;
+  if (!read_message_packet<TimeMsecSchema>(packet, msg))
+    return false;
+  timeMsec = msg.timeMsec;
+  return true;
 }
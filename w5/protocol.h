@@ -16,7 +16,8 @@ enum class MessageType : uint8_t
   ServerSetControlled,
   ClientInput,
   ServerSnapshot,
-  ServerTimeSync
+  ServerTimeSync,
+  Invalid = 0xff  // так get_packet_type сообщает о пустом пакете
 };
 
 // Отправка
@@ -31,9 +32,10 @@ void send_time_msec(ENetPeer* peer, uint32_t timeMsec);
 // Получение
 MessageType get_packet_type(ENetPacket* packet);
 
-void deserialize_new_entity(ENetPacket* packet, Entity& ent);
-void deserialize_set_controlled_entity(ENetPacket* packet, uint16_t& eid);
-void deserialize_entity_input(ENetPacket* packet, uint16_t& eid, float& thr, float& steer);
-void deserialize_snapshot(ENetPacket* packet, uint16_t& eid, float& x, float& y, float& ori,
+// false для обрезанного или испорченного пакета: такой пакет нужно просто отбросить
+bool deserialize_new_entity(ENetPacket* packet, Entity& ent);
+bool deserialize_set_controlled_entity(ENetPacket* packet, uint16_t& eid);
+bool deserialize_entity_input(ENetPacket* packet, uint16_t& eid, float& thr, float& steer);
+bool deserialize_snapshot(ENetPacket* packet, uint16_t& eid, float& x, float& y, float& ori,
                           float& vx, float& vy, float& omega, TimePoint& timestamp, uint32_t& frameNumber);
-void deserialize_time_msec(ENetPacket* packet, uint32_t& timeMsec);
+bool deserialize_time_msec(ENetPacket* packet, uint32_t& timeMsec);
@@ -9,19 +9,29 @@ enum MessageType : uint8_t
   E_SERVER_TO_CLIENT_NEW_ENTITY,
   E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY,
   E_CLIENT_TO_SERVER_INPUT,
-  E_SERVER_TO_CLIENT_SNAPSHOT
+  E_SERVER_TO_CLIENT_SNAPSHOT,
+  E_INVALID_PACKET = 0xff  // what get_packet_type reports for an empty packet
 };
 
+// Reliable messages go on channel 0, unsequenced input and snapshots on channel 1
+constexpr enet_uint8 reliable_channel = 0;
+constexpr enet_uint8 unreliable_channel = 1;
+
 void send_join(ENetPeer *peer);
 void send_new_entity(ENetPeer *peer, const Entity &ent);
 void send_set_controlled_entity(ENetPeer *peer, uint16_t eid);
 void send_entity_input(ENetPeer *peer, uint16_t eid, float thr, float steer);
 void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y, float ori);
 
+// Packets for fan-out: serialize once and hand to broadcast_packet on the matching channel
+ENetPacket *create_new_entity_packet(const Entity &ent);                         // reliable
+ENetPacket *create_snapshot_packet(uint16_t eid, float x, float y, float ori);  // unreliable
+
 MessageType get_packet_type(ENetPacket *packet);
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent);
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
-void deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer);
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori);
+// These return false for a truncated or malformed packet, which should then be dropped
+bool deserialize_new_entity(ENetPacket *packet, Entity &ent);
+bool deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
+bool deserialize_entity_input(ENetPacket *packet, uint16_t &eid, float &thr, float &steer);
+bool deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y, float &ori);
 
@@ -2,6 +2,7 @@
 #include <iostream>
 #include "entity.h"
 #include "protocol.h"
+#include "enet_broadcast.h"
 #include "mathUtils.h"
 #include <stdlib.h>
 #include <vector>
@@ -34,8 +35,7 @@ void on_join(ENetPacket *packet, ENetPeer *peer, ENetHost *host)
 
 
   // send info about new entity to everyone
-  for (size_t i = 0; i < host->peerCount; ++i)
-    send_new_entity(&host->peers[i], ent);
+  broadcast_packet(host, reliable_channel, create_new_entity_packet(ent));
   // send info about controlled entity
   send_set_controlled_entity(peer, newEid);
 }
@@ -44,7 +44,8 @@ void on_input(ENetPacket *packet)
 {
   uint16_t eid = invalid_entity;
   float thr = 0.f; float steer = 0.f;
-  deserialize_entity_input(packet, eid, thr, steer);
+  if (!deserialize_entity_input(packet, eid, thr, steer))
+    return;
   for (Entity &e : entities)
     if (e.eid == eid)
     {
@@ -108,14 +109,8 @@ int main(int argc, const char **argv)
     {
       // simulate
       simulate_entity(e, dt);
-      // send
-      for (size_t i = 0; i < server->peerCount; ++i)
-      {
-        ENetPeer *peer = &server->peers[i];
-        // skip this here in this implementation
-        //if (controlledMap[e.eid] != peer)
-        send_snapshot(peer, e.eid, e.x, e.y, e.ori);
-      }
+      // send, to the owner as well in this implementation
+      broadcast_packet(server, unreliable_channel, create_snapshot_packet(e.eid, e.x, e.y, e.ori));
     }
     usleep(10000);
   }